@@ -1,28 +1,211 @@
 #include "application.h"
 
 
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <vector>
+
+#include <utils/environment.h>
 #include <utils/ignore_unused.h>
 #include <vulkan/command_pool.h>
+#include <vulkan/completion_service.h>
+#include <vulkan/frame_graph.h>
 #include <vulkan/memory.h>
+#include <vulkan/readback.h>
 #include <vulkan/synchronization.h>
 
 
+namespace
+{
+    // Command buffer of a one-off upload, kept alive by the continuation that runs once it has finished.
+    struct OneOffCommands
+    {
+        explicit OneOffCommands(const ct::vulkan::Device& device, const ct::vulkan::QueueType queue_type) :
+            pool(device, queue_type, ct::vulkan::TransientCommandBuffers),
+            command_buffer(pool)
+        {
+        }
+
+        ct::vulkan::CommandPool     pool;
+        ct::vulkan::CommandBuffer   command_buffer;
+    };
+
+
+    // Everything a frame uses while it is in flight. Frame N uses the resources of slot N % frames_in_flight.
+    struct FrameResources
+    {
+        explicit FrameResources(const ct::vulkan::Device& device) :
+            image_acquired_semaphore(device),
+            render_finished_semaphore(device),
+            frame_graph(device)
+        {
+        }
+
+        ct::vulkan::Semaphore                   image_acquired_semaphore;
+        ct::vulkan::Semaphore                   render_finished_semaphore;
+        ct::vulkan::FrameGraph                  frame_graph;
+        // Taken from the fence pool while in flight when the device has no timeline semaphores.
+        ct::vulkan::Fence*                      fence = nullptr;
+
+        std::uint64_t                           frame_number = 0u;
+        bool                                    in_flight = false;
+        ct::FrameStatistics::Clock::time_point  input_time;
+    };
+
+
+    // Headless frames are RGBA so that they can be written out as they are.
+    const VkFormat OffscreenFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+
+    // Without a surface any device that renders will do. Hardware is preferred, but CPU implementations
+    // such as lavapipe are taken on machines without a GPU.
+    VkPhysicalDevice SelectHeadlessPhysicalDevice(const ct::vulkan::Instance& vk_instance)
+    {
+        VkPhysicalDevice selected_device = VK_NULL_HANDLE;
+        for (const VkPhysicalDevice physical_device : vk_instance.GetPhysicalDevices())
+        {
+            std::uint32_t queue_family_count = 0u;
+            vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
+            std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+            vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
+            const bool renders = std::any_of(queue_families.cbegin(), queue_families.cend(),
+                [](const VkQueueFamilyProperties& family)
+            {
+                const VkQueueFlags required_flags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+                return family.queueCount != 0u && (family.queueFlags & required_flags) == required_flags;
+            });
+            if (!renders)
+                continue;
+
+            VkPhysicalDeviceProperties properties = {};
+            vkGetPhysicalDeviceProperties(physical_device, &properties);
+            if (properties.deviceType != VK_PHYSICAL_DEVICE_TYPE_CPU)
+                return physical_device;
+            if (selected_device == VK_NULL_HANDLE)
+                selected_device = physical_device;
+        }
+        if (selected_device == VK_NULL_HANDLE)
+            throw ct::vulkan::Exception("No device with graphics and compute queues found");
+        return selected_device;
+    }
+
+
+    // Whether the frame can be kept in a device-local image of the target format and copied to the
+    // target on the device.
+    bool SupportsDeviceCopy(const ct::vulkan::Device& device, const VkFormat format, const VkExtent2D& extent)
+    {
+        VkImageFormatProperties properties = {};
+        const VkResult status = vkGetPhysicalDeviceImageFormatProperties(
+            device.GetPhysicalDevice(),
+            format,
+            VK_IMAGE_TYPE_2D,
+            VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            0u,
+            &properties);
+        return status == VK_SUCCESS &&
+            properties.maxExtent.width >= extent.width &&
+            properties.maxExtent.height >= extent.height;
+    }
+
+
+    // Drops the alpha channel of the RGBA texels.
+    void WritePortablePixmap(
+        const std::string&                          path,
+        const ct::vulkan::MemoryMap<std::uint8_t>&  memory_map,
+        const std::uint32_t                         width,
+        const std::uint32_t                         height)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            throw ct::vulkan::Exception("Unable to open " + path);
+        file << "P6\n" << width << " " << height << "\n255\n";
+        for (std::size_t i = 0u; i + 4u <= memory_map.GetCount(); i += 4u)
+        {
+            file.write(reinterpret_cast<const char*>(&memory_map[i]), 3);
+        }
+    }
+
+
+    // Frame 42 of "frame.ppm" goes to "frame.42.ppm".
+    std::string GetFrameOutputPath(const std::string& path, const std::uint64_t frame_number)
+    {
+        const std::size_t directory_end = path.find_last_of("/\\");
+        const std::size_t extension_begin = path.rfind('.');
+        if (extension_begin == std::string::npos || (directory_end != std::string::npos && extension_begin < directory_end))
+            return path + "." + std::to_string(frame_number);
+        return path.substr(0u, extension_begin) + "." + std::to_string(frame_number) + path.substr(extension_begin);
+    }
+
+
+    std::string GetPipelineCachePath()
+    {
+        const std::string path = ct::utils::ReadEnvironmentVariable(ct::Application::PipelineCachePathVariable);
+        return path.empty() ? ct::Application::DefaultPipelineCachePath : path;
+    }
+}
+
+
 namespace ct
 {
 
-Application::Application(const ct::vulkan::Instance& vk_instance, const std::string& name) :
+HeadlessSettings HeadlessSettings::FromEnvironment(const HeadlessSettings& defaults)
+{
+    HeadlessSettings settings = defaults;
+
+    const std::string enabled = utils::ReadEnvironmentVariable(HeadlessVariable);
+    if (!enabled.empty())
+    {
+        settings.enabled = (enabled != "0");
+    }
+    const std::string frame_count = utils::ReadEnvironmentVariable(FrameCountVariable);
+    if (!frame_count.empty())
+    {
+        settings.frame_count = std::strtoull(frame_count.c_str(), nullptr, 10);
+    }
+    const std::string output_path = utils::ReadEnvironmentVariable(OutputPathVariable);
+    if (!output_path.empty())
+    {
+        settings.output_path = output_path;
+    }
+    const std::string capture_frames = utils::ReadEnvironmentVariable(CaptureFramesVariable);
+    if (!capture_frames.empty())
+    {
+        settings.capture_frames = (capture_frames != "0");
+    }
+    return settings;
+}
+
+
+Application::Application(
+    const ct::vulkan::Instance& vk_instance,
+    const std::string&          name,
+    const FramePacing&          pacing,
+    const HeadlessSettings&     headless) :
     name(name),
     vk_instance(vk_instance),
-    window(name, DefaultWidth, DefaultHeight),
-    surface(vk_instance, window),
+    headless(headless),
+    window(headless.enabled ? nullptr : std::make_unique<const Window>(name, DefaultWidth, DefaultHeight)),
+    surface(headless.enabled ? nullptr : std::make_unique<const Window::Surface>(vk_instance, *window)),
     vk_device(
         vk_instance,
-        vk_instance.GetPhysicalDevices()[0],
-        ct::vulkan::PresentQueue | ct::vulkan::ComputeQueue | ct::vulkan::GraphicsQueue,
-        surface.GetHandler()),
+        headless.enabled ? SelectHeadlessPhysicalDevice(vk_instance) : vk_instance.GetPhysicalDevices()[0],
+        ct::vulkan::ComputeQueue | ct::vulkan::GraphicsQueue | ct::vulkan::TransferQueue |
+            (headless.enabled ? 0u : ct::vulkan::PresentQueue),
+        headless.enabled ? VK_NULL_HANDLE : surface->GetHandler(),
+        GetPipelineCachePath()),
+    pacing(FramePacing::FromEnvironment(pacing)),
+    swapchain_settings(this->pacing.swapchain),
+    swapchain_settings_changed(false),
     frame_number(0u),
-    is_running(false)
+    is_running(false),
+    stop_requested(false)
 {
+    // Nothing else would end a headless run.
+    if (headless.enabled && headless.frame_count == 0u)
+        throw vulkan::Exception("Headless runs need a frame count");
 }
 
 
@@ -31,104 +214,532 @@ void Application::Run()
     if (is_running)
         return;
     is_running = true;
+    stop_requested = false;
+    frame_statistics = FrameStatistics();
+    swapchain_statistics = vulkan::SwapchainStatistics();
+    swapchain_settings_changed = false;
 
-    vulkan::Swapchain vk_swapchain(vk_device, DefaultWidth, DefaultHeight);
+    // Headless frames go to offscreen images instead, one per frame in flight, and are never presented.
+    VkExtent2D swapchain_request = (window != nullptr) ?
+        window->GetFramebufferExtent() :
+        VkExtent2D{ DefaultWidth, DefaultHeight };
+    std::unique_ptr<vulkan::Swapchain> vk_swapchain;
+    std::vector<vulkan::Image2D> offscreen_images;
+    if (window != nullptr)
+    {
+        vk_swapchain = std::make_unique<vulkan::Swapchain>(
+            vk_device, swapchain_request.width, swapchain_request.height, GetSwapchainSettings());
+    }
+    else
+    {
+        offscreen_images.reserve(pacing.frames_in_flight);
+        for (std::uint32_t i = 0u; i != pacing.frames_in_flight; ++i)
+        {
+            offscreen_images.emplace_back(
+                vk_device,
+                OffscreenFormat,
+                DefaultWidth,
+                DefaultHeight,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                1u,
+                "offscreen image");
+        }
+    }
+    const auto get_target_image_count = [&vk_swapchain, &offscreen_images]()
+    {
+        return (vk_swapchain != nullptr) ? vk_swapchain->GetImages().size() : offscreen_images.size();
+    };
+    const auto get_target_image = [&vk_swapchain, &offscreen_images](const std::uint32_t index)
+    {
+        return (vk_swapchain != nullptr) ? vk_swapchain->GetImages()[index] : offscreen_images[index].GetImageHandle();
+    };
 
-    vulkan::Semaphore vk_semaphores[2] = {
-        vulkan::Semaphore(vk_device),
-        vulkan::Semaphore(vk_device)
+    // Only the part of the framebuffer that fits into the swapchain images is copied.
+    const auto get_blit_extent = [&vk_swapchain, &swapchain_request]()
+    {
+        const VkExtent2D extent = (vk_swapchain != nullptr) ? vk_swapchain->GetExtent() : swapchain_request;
+        return VkExtent2D{
+            std::min<std::uint32_t>(extent.width, DefaultWidth),
+            std::min<std::uint32_t>(extent.height, DefaultHeight) };
     };
-    std::uint32_t next_semaphore_index = 0u;
+    VkExtent2D blit_extent = get_blit_extent();
+    const auto get_target_extent = [&vk_swapchain, &swapchain_request]()
+    {
+        return (vk_swapchain != nullptr) ? vk_swapchain->GetExtent() : swapchain_request;
+    };
+    VkExtent2D target_extent = get_target_extent();
 
-    ct::vulkan::CommandPool command_pool(vk_device, ct::vulkan::GraphicsQueue);
+    // Waits for one-off work such as uploads, so the frame loop never blocks on it.
+    vulkan::CompletionService completion_service(vk_device);
 
-    ct::vulkan::StagingBuffer<std::uint8_t> staging_buffer(vk_device, DefaultWidth * DefaultHeight * 4);
+    ct::vulkan::StagingBuffer<std::uint8_t> staging_buffer(vk_device, DefaultWidth * DefaultHeight * 4, "framebuffer");
     {
         auto memory_map = ct::vulkan::MapMemory(staging_buffer);
         for (size_t i = 0; i < memory_map.GetCount(); i += 4)
         {
-            memory_map[i] = 0xFF;
+            memory_map.Write(i, 0xFF);
         }
+        memory_map.Flush();
     }
 
-    std::vector<ct::vulkan::CommandBuffer> blit_command_buffers;
-    const std::size_t images_count = vk_swapchain.GetImages().size();
-    blit_command_buffers.reserve(images_count);
-    for (size_t i = 0; i != images_count; ++i)
+    // The framebuffer is uploaded once into a device-local image of the target format, so every frame
+    // copies it on the device instead of across the bus. Without such an image every frame blits the
+    // staging buffer instead.
+    const VkFormat target_format = (vk_swapchain != nullptr) ?
+        vk_swapchain->GetSurfaceFormat().format :
+        OffscreenFormat;
+    std::unique_ptr<vulkan::Image2D> framebuffer_image;
+    if (SupportsDeviceCopy(vk_device, target_format, VkExtent2D{ DefaultWidth, DefaultHeight }))
     {
-        ct::vulkan::CommandBuffer initialize_image_layout_command_buffer(command_pool);
+        framebuffer_image = std::make_unique<vulkan::Image2D>(
+            vk_device,
+            target_format,
+            DefaultWidth,
+            DefaultHeight,
+            VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            1u,
+            "framebuffer");
+
+        // Frames copy from the image on the same queue, behind the upload's final barrier, so nothing waits
+        // for the upload on the host. Its command buffer is released once the service has seen it finish.
+        const auto upload = std::make_shared<OneOffCommands>(vk_device, vulkan::GraphicsQueue);
         {
-            ct::vulkan::CommandRecorder recorder(initialize_image_layout_command_buffer);
-            recorder.ImageMemoryBarrier(
-                vk_swapchain.GetImages()[i],
-                ct::vulkan::ImageLayout::Undefined, ct::vulkan::TopOfPipeStage,
-                ct::vulkan::ImageLayout::PresentSource, ct::vulkan::BottomOfPipeStage);
+            vulkan::CommandRecorder recorder(upload->command_buffer);
+            recorder.Upload(staging_buffer, *framebuffer_image, vulkan::ImageLayout::TransferSource, vulkan::TransferStage);
         }
+        vulkan::SubmitBatch upload_batch;
+        upload_batch.Add(upload->command_buffer);
+        completion_service.Submit(upload_batch, [upload]()
+        {
+            utils::IgnoreUnused(upload);
+        });
+    }
+
+    // Frame N signals N + 1 on the timeline semaphore; devices without timeline semaphores use a fence per frame.
+    std::unique_ptr<vulkan::TimelineSemaphore> frame_timeline;
+    if (vk_device.SupportsTimelineSemaphores())
+    {
+        frame_timeline = std::make_unique<vulkan::TimelineSemaphore>(vk_device, 0u);
+    }
+    vulkan::FencePool fence_pool(vk_device);
 
-        ct::vulkan::SubmitCommands(initialize_image_layout_command_buffer);
-        command_pool.WaitForQueue();
+    // The frame is described once per frame in flight, since a graph can only execute once at a time.
+    // The swapchain image is rebound to the acquired one every frame and its previous contents are
+    // discarded: the framebuffer is copied to its top-left corner and, when the image is larger, the
+    // rest is cleared first. Offscreen images are not left in any particular layout.
+    const auto clear_uncovered_target = [&blit_extent, &target_extent](vulkan::CommandRecorder& recorder, const VkImage image)
+    {
+        if (target_extent.width > blit_extent.width || target_extent.height > blit_extent.height)
+        {
+            recorder.ClearColorImage(image, VkClearColorValue{ { 0.0f, 0.0f, 0.0f, 1.0f } });
+        }
+    };
+    const vulkan::ImageLayout target_layout = (vk_swapchain != nullptr) ?
+        vulkan::ImageLayout::PresentSource :
+        vulkan::ImageLayout::TransferDestination;
+    const bool reads_back = (vk_swapchain == nullptr) && !headless.output_path.empty();
+    // The host writes out the copy of one frame while the device already copies the next one.
+    std::unique_ptr<vulkan::Readback<std::uint8_t>> readback;
+    if (reads_back)
+    {
+        readback = std::make_unique<vulkan::Readback<std::uint8_t>>(
+            vk_device, DefaultWidth * DefaultHeight * 4, "headless output");
+    }
+    // Frame numbers of the copies in flight, oldest first.
+    std::deque<std::uint64_t> captured_frames;
+    const auto is_captured = [this](const std::uint64_t number)
+    {
+        return headless.capture_frames || number + 1u == headless.frame_count;
+    };
+    const auto write_oldest_capture = [this, &readback, &captured_frames]()
+    {
+        const std::string path = headless.capture_frames ?
+            GetFrameOutputPath(headless.output_path, captured_frames.front()) :
+            headless.output_path;
+        WritePortablePixmap(path, readback->Map(), DefaultWidth, DefaultHeight);
+        readback->Release();
+        captured_frames.pop_front();
+    };
+    std::vector<std::unique_ptr<FrameResources>> frames;
+    vulkan::FrameGraph::ResourceHandle swapchain_image = 0u;
+    vulkan::FrameGraph::ResourceHandle output = 0u;
+    for (std::uint32_t i = 0u; i != pacing.frames_in_flight; ++i)
+    {
+        frames.push_back(std::make_unique<FrameResources>(vk_device));
+        vulkan::FrameGraph& frame_graph = frames.back()->frame_graph;
+        swapchain_image = frame_graph.ImportImage(
+            "swapchain image",
+            VK_NULL_HANDLE,
+            vulkan::ImageLayout::Undefined,
+            (vk_swapchain != nullptr) ? vulkan::ImageLayout::PresentSource : vulkan::ImageLayout::Undefined);
+        if (framebuffer_image != nullptr)
+        {
+            const auto framebuffer = frame_graph.ImportImage(
+                "framebuffer",
+                framebuffer_image->GetImageHandle(),
+                vulkan::ImageLayout::TransferSource,
+                vulkan::ImageLayout::TransferSource);
+            frame_graph.AddPass("present copy", vulkan::GraphicsQueue,
+                [&blit_extent, &clear_uncovered_target, framebuffer, swapchain_image, target_layout](vulkan::CommandRecorder& recorder, const vulkan::FrameGraph& graph)
+            {
+                clear_uncovered_target(recorder, graph.GetImage(swapchain_image));
+                recorder.CopyImage(
+                    graph.GetImage(framebuffer),
+                    vulkan::ImageLayout::TransferSource,
+                    graph.GetImage(swapchain_image),
+                    target_layout,
+                    { blit_extent.width, blit_extent.height, 1u });
+            })
+                .ReadImage(framebuffer, vulkan::ImageLayout::TransferSource, VK_ACCESS_TRANSFER_READ_BIT, vulkan::TransferStage)
+                .WriteImage(swapchain_image, vulkan::ImageLayout::TransferDestination, VK_ACCESS_TRANSFER_WRITE_BIT, vulkan::TransferStage);
+        }
+        else
+        {
+            const auto framebuffer = frame_graph.ImportBuffer("framebuffer", staging_buffer.GetBufferHandle());
+            frame_graph.AddPass("present blit", vulkan::GraphicsQueue,
+                [&staging_buffer, &blit_extent, &clear_uncovered_target, swapchain_image, target_layout](vulkan::CommandRecorder& recorder, const vulkan::FrameGraph& graph)
+            {
+                clear_uncovered_target(recorder, graph.GetImage(swapchain_image));
+                vulkan::BufferImageRegion region;
+                region.buffer_row_length = DefaultWidth;
+                region.buffer_image_height = DefaultHeight;
+                region.image_extent = { blit_extent.width, blit_extent.height, 1u };
+                recorder.Blit(staging_buffer, graph.GetImage(swapchain_image), { region }, target_layout);
+            })
+                .ReadBuffer(framebuffer, VK_ACCESS_TRANSFER_READ_BIT, vulkan::TransferStage)
+                .WriteImage(swapchain_image, vulkan::ImageLayout::TransferDestination, VK_ACCESS_TRANSFER_WRITE_BIT, vulkan::TransferStage);
+        }
 
-        ct::vulkan::CommandBuffer blit_command_buffer(command_pool);
+        if (reads_back)
         {
-            ct::vulkan::CommandRecorder recorder(blit_command_buffer);
-            recorder.Blit(
-                staging_buffer,
-                vk_swapchain.GetImages()[i],
-                DefaultWidth, DefaultHeight);
+            output = frame_graph.ImportBuffer("output", readback->GetTarget().GetBufferHandle());
+            frame_graph.AddPass("readback", vulkan::GraphicsQueue,
+                [this, &readback, &is_captured, swapchain_image](vulkan::CommandRecorder& recorder, const vulkan::FrameGraph& graph)
+            {
+                if (!is_captured(frame_number))
+                    return;
+                recorder.CopyImageToBuffer(
+                    graph.GetImage(swapchain_image),
+                    DefaultWidth,
+                    DefaultHeight,
+                    readback->GetTarget(),
+                    vulkan::ImageLayout::TransferSource);
+            })
+                .ReadImage(swapchain_image, vulkan::ImageLayout::TransferSource, VK_ACCESS_TRANSFER_READ_BIT, vulkan::TransferStage)
+                .WriteBuffer(output, VK_ACCESS_TRANSFER_WRITE_BIT, vulkan::TransferStage);
         }
-        blit_command_buffers.push_back(std::move(blit_command_buffer));
+        frame_graph.Compile();
     }
 
-    Start();
-    while (!window.ShouldClose())
+    // Completion of a frame is recorded when it is first seen finished, whether by polling or waiting.
+    const auto complete_frame = [this, &frame_timeline, &fence_pool](FrameResources& frame, const bool wait)
     {
-        glfwPollEvents();
+        if (!frame.in_flight)
+            return;
+        if (frame_timeline != nullptr)
+        {
+            if (wait)
+                frame_timeline->Wait(frame.frame_number + 1u);
+            else if (!frame_timeline->IsReached(frame.frame_number + 1u))
+                return;
+        }
+        else
+        {
+            if (wait)
+                frame.fence->Wait();
+            else if (!frame.fence->IsSignaled())
+                return;
+            fence_pool.Recycle(*frame.fence);
+            frame.fence = nullptr;
+        }
+        frame.in_flight = false;
+        frame_statistics.AddFrame(frame.input_time, FrameStatistics::Clock::now());
+    };
+
+    // The frame that last rendered to each swapchain image.
+    enum : std::uint64_t
+    {
+        NoFrame = ~std::uint64_t(0u)
+    };
+    std::vector<std::uint64_t> image_frame_numbers(get_target_image_count(), NoFrame);
+
+    // Only the swapchain and what depends on its size are recreated; the frame graphs and everything
+    // else are kept. Frames submitted before the recreation may still use the old swapchain's images,
+    // so it is destroyed once they have finished instead of idling the device.
+    bool swapchain_outdated = false;
+    std::uint64_t swapchain_recreation_frame = 0u;
+    const auto recreate_swapchain = [&](const VkExtent2D& framebuffer_extent)
+    {
+        swapchain_request = framebuffer_extent;
+        if (swapchain_settings_changed.exchange(false))
+        {
+            vk_swapchain->Recreate(framebuffer_extent.width, framebuffer_extent.height, GetSwapchainSettings());
+        }
+        else
+        {
+            vk_swapchain->Recreate(framebuffer_extent.width, framebuffer_extent.height);
+        }
+        image_frame_numbers.assign(vk_swapchain->GetImages().size(), NoFrame);
+        blit_extent = get_blit_extent();
+        target_extent = get_target_extent();
+        swapchain_outdated = false;
+        swapchain_recreation_frame = frame_number;
+    };
+
+    const auto sample_input = [this](FrameResources& frame)
+    {
+        if (window != nullptr)
+            glfwPollEvents();
+        frame.input_time = FrameStatistics::Clock::now();
         Update();
+    };
+
+    const auto should_stop = [this]()
+    {
+        if (stop_requested)
+            return true;
+        if (window != nullptr)
+            return window->ShouldClose();
+        return headless.frame_count != 0u && frame_number >= headless.frame_count;
+    };
 
-        // Acquire next swapchain image index.
-        std::uint32_t swapchain_image_index;
+    Start();
+    while (!should_stop())
+    {
+        for (auto& frame : frames)
         {
-            auto& signal_semaphore = vk_semaphores[next_semaphore_index];
-            swapchain_image_index = vk_swapchain.AcquireNextImageIndex(signal_semaphore);
+            complete_frame(*frame, false);
+        }
+        if (vk_swapchain != nullptr && vk_swapchain->HasRetired() && std::none_of(frames.cbegin(), frames.cend(),
+            [swapchain_recreation_frame](const std::unique_ptr<FrameResources>& frame)
+        {
+            return frame->in_flight && frame->frame_number < swapchain_recreation_frame;
+        }))
+        {
+            vk_swapchain->DestroyRetired();
         }
 
-        // Blit host buffer into the swapchain image.
-        if (true) {
-            auto& wait_semaphore = vk_semaphores[next_semaphore_index];
-            next_semaphore_index = (next_semaphore_index + 1) % 2;
-            auto& signal_semaphore = vk_semaphores[next_semaphore_index];
-            vulkan::SubmitCommands(
-                blit_command_buffers[swapchain_image_index],
-                vulkan::ColorAttachmentOutputStage,
-                wait_semaphore,
-                &signal_semaphore);
+        if (window != nullptr)
+        {
+            // A minimized window has no framebuffer to present to.
+            const VkExtent2D framebuffer_extent = window->GetFramebufferExtent();
+            if (framebuffer_extent.width == 0u || framebuffer_extent.height == 0u)
+            {
+                glfwWaitEvents();
+                continue;
+            }
+            if (swapchain_outdated ||
+                swapchain_settings_changed ||
+                framebuffer_extent.width != swapchain_request.width ||
+                framebuffer_extent.height != swapchain_request.height)
+            {
+                recreate_swapchain(framebuffer_extent);
+            }
         }
 
-        // Present.
+        // In low latency mode the CPU blocks before input is sampled rather than with sampled input in hand.
+        FrameResources& frame = *frames[frame_number % frames.size()];
+        if (!pacing.low_latency)
+        {
+            sample_input(frame);
+        }
+        complete_frame(frame, true);
+        if (pacing.low_latency)
+        {
+            sample_input(frame);
+        }
+        frame.frame_number = frame_number;
+
+        // Acquire next swapchain image index. The image may still be written by an older frame in another slot.
+        // A suboptimal image is still rendered and presented, since its semaphore will be signaled.
+        // Offscreen images are used in turn, so each one belongs to a single slot.
+        std::uint32_t swapchain_image_index = 0u;
+        vulkan::SwapchainStatus acquire_status = vulkan::SwapchainStatus::Optimal;
+        if (vk_swapchain != nullptr)
+        {
+            acquire_status = vk_swapchain->AcquireNextImageIndex(frame.image_acquired_semaphore, swapchain_image_index);
+            if (acquire_status == vulkan::SwapchainStatus::OutOfDate)
+            {
+                swapchain_outdated = true;
+                continue;
+            }
+        }
+        else
+        {
+            swapchain_image_index = static_cast<std::uint32_t>(frame_number % offscreen_images.size());
+        }
+        const std::uint64_t image_frame_number = image_frame_numbers[swapchain_image_index];
+        if (image_frame_number != NoFrame)
+        {
+            FrameResources& image_frame = *frames[image_frame_number % frames.size()];
+            if (image_frame.frame_number == image_frame_number)
+                complete_frame(image_frame, true);
+        }
+        image_frame_numbers[swapchain_image_index] = frame_number;
+
+        // Write out the captures that have arrived, and block on the oldest only when no slot is free.
+        const bool captures_frame = (readback != nullptr) && is_captured(frame_number);
+        if (readback != nullptr)
         {
-            auto& wait_semaphore = vk_semaphores[next_semaphore_index];
-            next_semaphore_index = (next_semaphore_index + 1) % 2;
-            VkPresentInfoKHR present_info = {};
-            present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-            present_info.waitSemaphoreCount = 1;
-            present_info.pWaitSemaphores = &wait_semaphore.GetHandle();
-            present_info.swapchainCount = 1;
-            present_info.pSwapchains = &vk_swapchain.GetHandle();
-            present_info.pImageIndices = &swapchain_image_index;
-            if (vkQueuePresentKHR(vk_device.GetQueue(vulkan::PresentQueue), &present_info) != VK_SUCCESS)
+            while (readback->IsReady())
             {
-                throw vulkan::Exception("Failed to present the frame");
+                write_oldest_capture();
             }
+            if (captures_frame && captured_frames.size() == vulkan::Readback<std::uint8_t>::SlotCount)
+            {
+                readback->Wait();
+                write_oldest_capture();
+            }
+        }
+
+        // Record and submit the frame.
+        frame.frame_graph.SetImportedImage(swapchain_image, get_target_image(swapchain_image_index));
+        if (captures_frame)
+        {
+            frame.frame_graph.SetImportedBuffer(output, readback->GetTarget().GetBufferHandle());
+        }
+        const vulkan::Semaphore* wait_semaphore = (vk_swapchain != nullptr) ? &frame.image_acquired_semaphore : nullptr;
+        const vulkan::Semaphore* signal_semaphore = (vk_swapchain != nullptr) ? &frame.render_finished_semaphore : nullptr;
+        if (frame_timeline != nullptr)
+        {
+            frame.frame_graph.Execute(
+                wait_semaphore,
+                vulkan::TransferStage,
+                signal_semaphore,
+                *frame_timeline,
+                frame_number + 1u);
+        }
+        else
+        {
+            frame.fence = &fence_pool.Acquire();
+            frame.frame_graph.Execute(
+                wait_semaphore,
+                vulkan::TransferStage,
+                signal_semaphore,
+                frame.fence);
+        }
+        frame.in_flight = true;
+        if (captures_frame)
+        {
+            // An empty submission's fence covers everything submitted to the queue before it.
+            vulkan::SubmitBatch capture_batch(vk_device.GetQueue(vulkan::GraphicsQueue));
+            capture_batch.Submit(&readback->GetTargetFence());
+            readback->Submitted();
+            captured_frames.push_back(frame_number);
+        }
+
+        // Present.
+        if (vk_swapchain != nullptr &&
+            (vk_swapchain->Present(frame.render_finished_semaphore, swapchain_image_index) != vulkan::SwapchainStatus::Optimal ||
+            acquire_status != vulkan::SwapchainStatus::Optimal))
+        {
+            swapchain_outdated = true;
         }
 
         ++frame_number;
     }
+    if (frame_timeline == nullptr)
+    {
+        std::vector<const vulkan::Fence*> in_flight_fences;
+        for (const auto& frame : frames)
+        {
+            if (frame->in_flight)
+                in_flight_fences.push_back(frame->fence);
+        }
+        vulkan::WaitAll(vk_device, in_flight_fences);
+    }
+    for (auto& frame : frames)
+    {
+        complete_frame(*frame, true);
+    }
+    // The one-off work has to be done before the buffers and images it uses go away.
+    completion_service.WaitIdle();
     Destroy();
+    if (vk_swapchain != nullptr)
+    {
+        swapchain_statistics = vk_swapchain->GetStatistics();
+    }
+    while (readback != nullptr && readback->HasPending())
+    {
+        readback->Wait();
+        write_oldest_capture();
+    }
+    // A missing cache only costs compile time on the next run, so the run itself does not fail.
+    if (!vk_device.SavePipelineCache())
+    {
+        std::cerr << "Failed to save the pipeline cache" << std::endl;
+    }
+
+    const std::string statistics_path = utils::ReadEnvironmentVariable(FrameStatistics::StatisticsPathVariable);
+    if (!statistics_path.empty())
+    {
+        std::ofstream statistics_file(statistics_path);
+        statistics_file << "{\"frames\": ";
+        frame_statistics.WriteJson(statistics_file, pacing);
+        if (vk_swapchain != nullptr)
+        {
+            // The requested mode is part of the frame statistics, this is the one the surface granted.
+            statistics_file << ", \"present_mode\": \"" << vulkan::GetPresentModeName(vk_swapchain->GetPresentMode()) << "\"";
+            statistics_file << ", \"swapchain\": ";
+            swapchain_statistics.WriteJson(statistics_file);
+        }
+        statistics_file << ", \"frame_output\": \"" << ((framebuffer_image != nullptr) ? "device_copy" : "staging_blit") << "\""
+            << ", \"headless\": " << (headless.enabled ? "true" : "false")
+            << ", \"pipeline_cache_warm\": " << (vk_device.IsPipelineCacheWarm() ? "true" : "false") << "}\n";
+    }
+
     is_running = false;
     frame_number = 0u;
 }
 
 
+void Application::Stop()
+{
+    stop_requested = true;
+}
+
+
+const FramePacing& Application::GetFramePacing() const
+{
+    return pacing;
+}
+
+
+bool Application::IsHeadless() const
+{
+    return headless.enabled;
+}
+
+
+const FrameStatistics& Application::GetFrameStatistics() const
+{
+    return frame_statistics;
+}
+
+
+const vulkan::SwapchainStatistics& Application::GetSwapchainStatistics() const
+{
+    return swapchain_statistics;
+}
+
+
+void Application::SetSwapchainSettings(const vulkan::SwapchainSettings& settings)
+{
+    {
+        std::lock_guard<std::mutex> lock(swapchain_settings_mutex);
+        swapchain_settings = settings;
+    }
+    swapchain_settings_changed = true;
+}
+
+
+vulkan::SwapchainSettings Application::GetSwapchainSettings() const
+{
+    std::lock_guard<std::mutex> lock(swapchain_settings_mutex);
+    return swapchain_settings;
+}
+
+
 const std::string& Application::GetName() const
 {
     return name;
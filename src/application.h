@@ -1,7 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
 
 #include <vulkan/debug_messenger.h>
@@ -9,19 +12,70 @@
 #include <vulkan/instance.h>
 #include <vulkan/swapchain.h>
 
+#include <frame_pacing.h>
 #include <window.h>
 
 
 namespace ct
 {
 
+// Renders into offscreen images instead of a window, on a device without a surface, so nothing
+// needs GLFW or a display and frames are not throttled by vsync or a compositor.
+struct HeadlessSettings
+{
+    bool            enabled = false;
+
+    // Number of frames Run() renders before it returns. Has to be non-zero when enabled.
+    std::uint64_t   frame_count = 1000u;
+
+    // Binary PPM file the last frame is written to. Nothing is read back when it is empty, or when
+    // Stop() ends the run early.
+    std::string     output_path;
+
+    // Writes every frame instead, numbered before the extension of the output path.
+    bool            capture_frames = false;
+
+    // Overrides the given settings with the variables below when they are set. Has to be resolved
+    // before the instance is created, since only windowed runs need the GLFW instance extensions.
+    static HeadlessSettings FromEnvironment(const HeadlessSettings& defaults);
+
+    static constexpr const char* HeadlessVariable = "CT_HEADLESS";
+    static constexpr const char* FrameCountVariable = "CT_HEADLESS_FRAME_COUNT";
+    static constexpr const char* OutputPathVariable = "CT_HEADLESS_OUTPUT_PATH";
+    static constexpr const char* CaptureFramesVariable = "CT_HEADLESS_CAPTURE_FRAMES";
+};
+
+
 class Application
 {
 public:
-    Application(const ct::vulkan::Instance& vk_instance, const std::string& name);
+    // The pacing can be overridden per deployment through the environment, see FramePacing::FromEnvironment.
+    Application(
+        const ct::vulkan::Instance& vk_instance,
+        const std::string&          name,
+        const FramePacing&          pacing = FramePacing(),
+        const HeadlessSettings&     headless = HeadlessSettings());
 
     void Run();
+    // Makes Run() return after the current frame.
+    void Stop();
     const std::string& GetName() const;
+    const FramePacing& GetFramePacing() const;
+    bool IsHeadless() const;
+
+    // Statistics of the last Run().
+    const FrameStatistics& GetFrameStatistics() const;
+    const vulkan::SwapchainStatistics& GetSwapchainStatistics() const;
+
+    // Switches the present mode and number of swapchain images. While running, the swapchain is
+    // recreated with them before the next frame. Can be called from any thread.
+    void SetSwapchainSettings(const vulkan::SwapchainSettings& settings);
+    vulkan::SwapchainSettings GetSwapchainSettings() const;
+
+    // File the device's pipeline cache is loaded from and saved to, relative to the working directory
+    // unless the variable gives an absolute path.
+    static constexpr const char* PipelineCachePathVariable = "CT_PIPELINE_CACHE_PATH";
+    static constexpr const char* DefaultPipelineCachePath = "cloud_tracer.pipeline_cache";
 
     enum
     {
@@ -39,12 +93,22 @@ private:
 
     const vulkan::Instance&     vk_instance;
 
-    const Window                window;
-    const Window::Surface       surface;
-    const vulkan::Device        vk_device;
+    // The window and its surface only exist when not headless.
+    const HeadlessSettings                          headless;
+    const std::unique_ptr<const Window>             window;
+    const std::unique_ptr<const Window::Surface>    surface;
+    const vulkan::Device                            vk_device;
+    const FramePacing                               pacing;
 
-    std::size_t     frame_number;
-    bool            is_running;
+    FrameStatistics             frame_statistics;
+    vulkan::SwapchainStatistics swapchain_statistics;
+    // Written by SetSwapchainSettings from any thread, read by Run.
+    vulkan::SwapchainSettings   swapchain_settings;
+    mutable std::mutex          swapchain_settings_mutex;
+    std::atomic<bool>           swapchain_settings_changed;
+    std::size_t                 frame_number;
+    bool                        is_running;
+    bool                        stop_requested;
 };
 
 }
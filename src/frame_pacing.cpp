@@ -0,0 +1,119 @@
+#include "frame_pacing.h"
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+
+#include <utils/environment.h>
+#include <vulkan/exception.h>
+
+
+namespace
+{
+    VkPresentModeKHR ParsePresentMode(const std::string& name)
+    {
+        if (name == "immediate")
+            return VK_PRESENT_MODE_IMMEDIATE_KHR;
+        if (name == "mailbox")
+            return VK_PRESENT_MODE_MAILBOX_KHR;
+        if (name == "fifo")
+            return VK_PRESENT_MODE_FIFO_KHR;
+        if (name == "fifo_relaxed")
+            return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+        throw ct::vulkan::Exception("Unknown present mode: " + name);
+    }
+}
+
+
+namespace ct
+{
+
+FramePacing FramePacing::FromEnvironment(const FramePacing& defaults)
+{
+    FramePacing pacing = defaults;
+
+    const std::string frames_in_flight = utils::ReadEnvironmentVariable(FramesInFlightVariable);
+    if (!frames_in_flight.empty())
+    {
+        pacing.frames_in_flight = static_cast<std::uint32_t>(std::strtoul(frames_in_flight.c_str(), nullptr, 10));
+    }
+    pacing.frames_in_flight = std::min<std::uint32_t>(
+        std::max<std::uint32_t>(pacing.frames_in_flight, MinFramesInFlight),
+        MaxFramesInFlight);
+
+    const std::string low_latency = utils::ReadEnvironmentVariable(LowLatencyVariable);
+    if (!low_latency.empty())
+    {
+        pacing.low_latency = (low_latency != "0");
+    }
+
+    const std::string present_mode = utils::ReadEnvironmentVariable(PresentModeVariable);
+    if (!present_mode.empty())
+    {
+        pacing.swapchain.present_mode = ParsePresentMode(present_mode);
+    }
+    const std::string image_count = utils::ReadEnvironmentVariable(SwapchainImageCountVariable);
+    if (!image_count.empty())
+    {
+        pacing.swapchain.image_count = static_cast<std::uint32_t>(std::strtoul(image_count.c_str(), nullptr, 10));
+    }
+    const std::string refresh_rate = utils::ReadEnvironmentVariable(RefreshRateVariable);
+    if (!refresh_rate.empty())
+    {
+        const double rate = std::strtod(refresh_rate.c_str(), nullptr);
+        pacing.swapchain.refresh_interval = (rate > 0.0) ? 1.0 / rate : 0.0;
+    }
+    return pacing;
+}
+
+
+void FrameStatistics::AddFrame(const Clock::time_point input_time, const Clock::time_point completion_time)
+{
+    if (frame_count == 0u)
+    {
+        first_input_time = input_time;
+    }
+    ++frame_count;
+    last_completion_time = std::max(last_completion_time, completion_time);
+
+    const double latency = std::chrono::duration<double>(completion_time - input_time).count();
+    latency_sum += latency;
+    max_latency = std::max(max_latency, latency);
+}
+
+std::uint64_t FrameStatistics::GetFrameCount() const
+{
+    return frame_count;
+}
+
+double FrameStatistics::GetFramesPerSecond() const
+{
+    const double duration = std::chrono::duration<double>(last_completion_time - first_input_time).count();
+    return (frame_count == 0u || duration <= 0.0) ? 0.0 : static_cast<double>(frame_count) / duration;
+}
+
+double FrameStatistics::GetAverageLatency() const
+{
+    return (frame_count == 0u) ? 0.0 : latency_sum / static_cast<double>(frame_count);
+}
+
+double FrameStatistics::GetMaxLatency() const
+{
+    return max_latency;
+}
+
+void FrameStatistics::WriteJson(std::ostream& stream, const FramePacing& pacing) const
+{
+    stream
+        << "{\"frames_in_flight\": " << pacing.frames_in_flight
+        << ", \"low_latency\": " << (pacing.low_latency ? "true" : "false")
+        << ", \"requested_present_mode\": \"" << vulkan::GetPresentModeName(pacing.swapchain.present_mode) << "\""
+        << ", \"frame_count\": " << frame_count
+        << ", \"frames_per_second\": " << GetFramesPerSecond()
+        << ", \"average_latency_seconds\": " << GetAverageLatency()
+        << ", \"max_latency_seconds\": " << GetMaxLatency()
+        << "}";
+}
+
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include <vulkan/swapchain.h>
+
+
+namespace ct
+{
+
+struct FramePacing
+{
+    enum : std::uint32_t
+    {
+        MinFramesInFlight = 1u,
+        MaxFramesInFlight = 3u
+    };
+
+    // More frames in flight let the CPU run ahead of the GPU for throughput, but every extra frame
+    // adds a frame of input latency.
+    std::uint32_t   frames_in_flight = 2u;
+
+    // Waits for the next frame's resources before sampling input rather than after it, so the input
+    // is as recent as possible when the frame is recorded.
+    bool            low_latency = false;
+
+    vulkan::SwapchainSettings swapchain;
+
+    // Overrides the given settings with the variables below when they are set. The number of frames
+    // in flight is clamped to [MinFramesInFlight, MaxFramesInFlight]. The present mode is one of
+    // "immediate", "mailbox", "fifo" and "fifo_relaxed". The refresh rate of the display is given in Hz;
+    // without it late presents and missed refreshes are not counted.
+    static FramePacing FromEnvironment(const FramePacing& defaults);
+
+    static constexpr const char* FramesInFlightVariable = "CT_FRAMES_IN_FLIGHT";
+    static constexpr const char* LowLatencyVariable = "CT_LOW_LATENCY";
+    static constexpr const char* PresentModeVariable = "CT_PRESENT_MODE";
+    static constexpr const char* SwapchainImageCountVariable = "CT_SWAPCHAIN_IMAGE_COUNT";
+    static constexpr const char* RefreshRateVariable = "CT_REFRESH_RATE";
+};
+
+
+// Throughput and input-to-completion latency of rendered frames. The latency runs from the moment the
+// frame sampled input until the host saw the GPU finish it, so it is slightly overestimated.
+class FrameStatistics
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void AddFrame(const Clock::time_point input_time, const Clock::time_point completion_time);
+
+    std::uint64_t GetFrameCount() const;
+    double GetFramesPerSecond() const;
+    double GetAverageLatency() const;
+    double GetMaxLatency() const;
+
+    void WriteJson(std::ostream& stream, const FramePacing& pacing) const;
+
+    // Environment variable naming a file the statistics are written to when Application::Run ends.
+    static constexpr const char* StatisticsPathVariable = "CT_FRAME_STATISTICS_PATH";
+
+private:
+    std::uint64_t       frame_count = 0u;
+    Clock::time_point   first_input_time;
+    Clock::time_point   last_completion_time;
+    double              latency_sum = 0.0;
+    double              max_latency = 0.0;
+};
+
+}
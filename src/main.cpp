@@ -1,6 +1,9 @@
 #include <application.h>
 
 
+#include <cstring>
+#include <memory>
+
 #include <utils/ignore_unused.h>
 
 
@@ -10,8 +13,8 @@ namespace ct
     class CloudTracerApplication : public Application
     {
     public:
-        explicit CloudTracerApplication(const ct::vulkan::Instance& vk_instance) :
-            Application(vk_instance, "Cloud Tracer") {}
+        CloudTracerApplication(const ct::vulkan::Instance& vk_instance, const HeadlessSettings& headless) :
+            Application(vk_instance, "Cloud Tracer", FramePacing(), headless) {}
 
     protected:
         virtual void Start() override
@@ -46,18 +49,33 @@ VKAPI_ATTR VkBool32 VKAPI_CALL DebugCallback(
 }
 
 
-int main()
+int main(int argc, char** argv)
 {
-    glfwInit();
-    std::uint32_t glfw_ext_count;
-    const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
-    ct::vulkan::Instance vk_instance("Cloud Tracer", "", std::vector<const char*>(glfw_ext, glfw_ext + glfw_ext_count), true);
-    ct::vulkan::DebugMessenger vk_debug_messenger(vk_instance, DebugCallback);
+    ct::HeadlessSettings headless = ct::HeadlessSettings::FromEnvironment(ct::HeadlessSettings());
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--headless") == 0)
+            headless.enabled = true;
+    }
 
-    ct::CloudTracerApplication application(vk_instance);
+    // Headless runs neither touch GLFW nor enable the validation layer, which render nodes
+    // usually do not have installed.
+    std::vector<const char*> instance_extensions;
+    if (!headless.enabled)
+    {
+        glfwInit();
+        std::uint32_t glfw_ext_count;
+        const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+        instance_extensions.assign(glfw_ext, glfw_ext + glfw_ext_count);
+    }
+    ct::vulkan::Instance vk_instance("Cloud Tracer", "", instance_extensions, !headless.enabled);
+    std::unique_ptr<ct::vulkan::DebugMessenger> vk_debug_messenger;
+    if (vk_instance.validation_layer_enabled)
+        vk_debug_messenger = std::make_unique<ct::vulkan::DebugMessenger>(vk_instance, DebugCallback);
 
     try
     {
+        ct::CloudTracerApplication application(vk_instance, headless);
         application.Run();
     }
     catch (const std::exception& e)
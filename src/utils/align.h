@@ -0,0 +1,28 @@
+#pragma once
+
+
+namespace ct
+{
+    namespace utils
+    {
+        template <typename T>
+        constexpr T AlignUp(const T value, const T alignment);
+
+        template <typename T>
+        constexpr T AlignDown(const T value, const T alignment);
+    }
+}
+
+
+template <typename T>
+constexpr T ct::utils::AlignUp(const T value, const T alignment)
+{
+    return (value + alignment - 1u) / alignment * alignment;
+}
+
+
+template <typename T>
+constexpr T ct::utils::AlignDown(const T value, const T alignment)
+{
+    return value / alignment * alignment;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+
+#include <cstdlib>
+#include <string>
+
+
+namespace ct
+{
+    namespace utils
+    {
+        // Value of an environment variable, or an empty string if it is not set.
+        inline std::string ReadEnvironmentVariable(const char* name);
+    }
+}
+
+
+std::string ct::utils::ReadEnvironmentVariable(const char* name)
+{
+#ifdef _MSC_VER
+    char* buffer = nullptr;
+    std::size_t length = 0u;
+    if (_dupenv_s(&buffer, &length, name) != 0 || buffer == nullptr)
+        return std::string();
+    std::string value(buffer);
+    std::free(buffer);
+    return value;
+#else
+    const char* value = std::getenv(name);
+    return (value == nullptr) ? std::string() : std::string(value);
+#endif
+}
@@ -0,0 +1,249 @@
+#include "allocation_tracker.h"
+
+
+#include <algorithm>
+#include <cassert>
+
+#include <vulkan/allocator.h>
+
+
+namespace
+{
+    const char* const UntaggedName = "untagged";
+
+    std::string GetTag(const ct::vulkan::MemoryAllocation& allocation)
+    {
+        return (allocation.tag == nullptr) ? std::string(UntaggedName) : std::string(allocation.tag);
+    }
+
+    void WriteJsonString(std::ostream& stream, const std::string& value)
+    {
+        stream << '"';
+        for (const char c : value)
+        {
+            if (c == '"' || c == '\\')
+                stream << '\\';
+            stream << c;
+        }
+        stream << '"';
+    }
+
+    void WriteJsonStatistics(std::ostream& stream, const ct::vulkan::AllocationStatistics& statistics)
+    {
+        stream
+            << "{\"live_allocation_count\": " << statistics.live_allocation_count
+            << ", \"allocated_bytes\": " << statistics.allocated_bytes
+            << ", \"peak_allocated_bytes\": " << statistics.peak_allocated_bytes
+            << ", \"block_count\": " << statistics.block_count
+            << ", \"block_bytes\": " << statistics.block_bytes
+            << ", \"peak_block_bytes\": " << statistics.peak_block_bytes
+            << "}";
+    }
+
+    void WriteJsonRates(std::ostream& stream, const ct::vulkan::AllocationRates& rates)
+    {
+        stream
+            << "{\"allocations_per_second\": " << rates.allocations_per_second
+            << ", \"frees_per_second\": " << rates.frees_per_second
+            << "}";
+    }
+
+    bool IsUsed(const ct::vulkan::AllocationStatistics& statistics)
+    {
+        return statistics.peak_allocated_bytes != 0u || statistics.peak_block_bytes != 0u;
+    }
+}
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+AllocationTracker::AllocationTracker() :
+    start_time(Clock::now()),
+    sample_time(start_time)
+{
+}
+
+void AllocationTracker::RecordAllocation(const MemoryAllocation& allocation, const std::uint32_t heap_index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    AddAllocation(total, allocation.size);
+    AddAllocation(memory_types[allocation.memory_type_index], allocation.size);
+    AddAllocation(heaps[heap_index], allocation.size);
+    AddAllocation(tags[GetTag(allocation)], allocation.size);
+    ++allocation_count;
+}
+
+void AllocationTracker::RecordFree(const MemoryAllocation& allocation, const std::uint32_t heap_index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    RemoveAllocation(total, allocation.size);
+    RemoveAllocation(memory_types[allocation.memory_type_index], allocation.size);
+    RemoveAllocation(heaps[heap_index], allocation.size);
+    RemoveAllocation(tags[GetTag(allocation)], allocation.size);
+    ++free_count;
+}
+
+void AllocationTracker::RecordBlockAllocation(
+    const std::uint32_t memory_type_index,
+    const std::uint32_t heap_index,
+    const VkDeviceSize  size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    AddBlock(total, size);
+    AddBlock(memory_types[memory_type_index], size);
+    AddBlock(heaps[heap_index], size);
+}
+
+void AllocationTracker::RecordBlockFree(
+    const std::uint32_t memory_type_index,
+    const std::uint32_t heap_index,
+    const VkDeviceSize  size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    RemoveBlock(total, size);
+    RemoveBlock(memory_types[memory_type_index], size);
+    RemoveBlock(heaps[heap_index], size);
+}
+
+AllocationStatistics AllocationTracker::GetTotalStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return total;
+}
+
+AllocationStatistics AllocationTracker::GetMemoryTypeStatistics(const std::uint32_t memory_type_index) const
+{
+    assert(memory_type_index < VK_MAX_MEMORY_TYPES);
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_types[memory_type_index];
+}
+
+AllocationStatistics AllocationTracker::GetHeapStatistics(const std::uint32_t heap_index) const
+{
+    assert(heap_index < VK_MAX_MEMORY_HEAPS);
+    std::lock_guard<std::mutex> lock(mutex);
+    return heaps[heap_index];
+}
+
+std::map<std::string, AllocationStatistics> AllocationTracker::GetTagStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tags;
+}
+
+AllocationRates AllocationTracker::GetLifetimeRates() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return ComputeRates(allocation_count, free_count, Clock::now() - start_time);
+}
+
+AllocationRates AllocationTracker::SampleRates()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Clock::time_point now = Clock::now();
+    const AllocationRates rates = ComputeRates(
+        allocation_count - sample_allocation_count,
+        free_count - sample_free_count,
+        now - sample_time);
+    sample_time = now;
+    sample_allocation_count = allocation_count;
+    sample_free_count = free_count;
+    return rates;
+}
+
+void AllocationTracker::WriteJson(std::ostream& stream) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const Clock::time_point now = Clock::now();
+
+    stream << "{\n";
+    stream << "  \"uptime_seconds\": " << std::chrono::duration<double>(now - start_time).count() << ",\n";
+    stream << "  \"allocation_count\": " << allocation_count << ",\n";
+    stream << "  \"free_count\": " << free_count << ",\n";
+    stream << "  \"lifetime_rates\": ";
+    WriteJsonRates(stream, ComputeRates(allocation_count, free_count, now - start_time));
+    stream << ",\n";
+    stream << "  \"total\": ";
+    WriteJsonStatistics(stream, total);
+    stream << ",\n";
+
+    // Only types and heaps that have ever been used, keyed by their index.
+    const auto write_indexed = [&stream](const char* name, const AllocationStatistics* statistics, const std::uint32_t count)
+    {
+        stream << "  \"" << name << "\": {";
+        bool first = true;
+        for (std::uint32_t index = 0u; index != count; ++index)
+        {
+            if (!IsUsed(statistics[index]))
+                continue;
+            stream << (first ? "\n    \"" : ",\n    \"") << index << "\": ";
+            WriteJsonStatistics(stream, statistics[index]);
+            first = false;
+        }
+        stream << (first ? "},\n" : "\n  },\n");
+    };
+    write_indexed("memory_types", memory_types, VK_MAX_MEMORY_TYPES);
+    write_indexed("heaps", heaps, VK_MAX_MEMORY_HEAPS);
+
+    stream << "  \"tags\": {";
+    bool first = true;
+    for (const auto& tag : tags)
+    {
+        stream << (first ? "\n    " : ",\n    ");
+        WriteJsonString(stream, tag.first);
+        stream << ": ";
+        WriteJsonStatistics(stream, tag.second);
+        first = false;
+    }
+    stream << (first ? "}\n" : "\n  }\n");
+    stream << "}\n";
+}
+
+void AllocationTracker::AddAllocation(AllocationStatistics& statistics, const VkDeviceSize size)
+{
+    ++statistics.live_allocation_count;
+    statistics.allocated_bytes += size;
+    statistics.peak_allocated_bytes = std::max(statistics.peak_allocated_bytes, statistics.allocated_bytes);
+}
+
+void AllocationTracker::RemoveAllocation(AllocationStatistics& statistics, const VkDeviceSize size)
+{
+    assert(statistics.live_allocation_count > 0u && statistics.allocated_bytes >= size);
+    --statistics.live_allocation_count;
+    statistics.allocated_bytes -= size;
+}
+
+void AllocationTracker::AddBlock(AllocationStatistics& statistics, const VkDeviceSize size)
+{
+    ++statistics.block_count;
+    statistics.block_bytes += size;
+    statistics.peak_block_bytes = std::max(statistics.peak_block_bytes, statistics.block_bytes);
+}
+
+void AllocationTracker::RemoveBlock(AllocationStatistics& statistics, const VkDeviceSize size)
+{
+    assert(statistics.block_count > 0u && statistics.block_bytes >= size);
+    --statistics.block_count;
+    statistics.block_bytes -= size;
+}
+
+AllocationRates AllocationTracker::ComputeRates(
+    const std::uint64_t     allocations,
+    const std::uint64_t     frees,
+    const Clock::duration   duration)
+{
+    AllocationRates rates;
+    const double seconds = std::chrono::duration<double>(duration).count();
+    if (seconds > 0.0)
+    {
+        rates.allocations_per_second = static_cast<double>(allocations) / seconds;
+        rates.frees_per_second = static_cast<double>(frees) / seconds;
+    }
+    return rates;
+}
+
+}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        struct MemoryAllocation;
+
+
+        struct AllocationStatistics
+        {
+            std::uint64_t   live_allocation_count = 0u;
+            VkDeviceSize    allocated_bytes = 0u;       // Requested by resources
+            VkDeviceSize    peak_allocated_bytes = 0u;
+            std::uint64_t   block_count = 0u;
+            VkDeviceSize    block_bytes = 0u;           // Reserved with vkAllocateMemory
+            VkDeviceSize    peak_block_bytes = 0u;
+        };
+
+
+        struct AllocationRates
+        {
+            double  allocations_per_second = 0.0;
+            double  frees_per_second = 0.0;
+        };
+
+
+        // Aggregates the resource allocations and device memory blocks of a MemoryAllocator
+        // per memory type, heap and tag. Safe to query from any thread.
+        class AllocationTracker
+        {
+        public:
+            AllocationTracker();
+            AllocationTracker(const AllocationTracker& other) = delete;
+
+            void RecordAllocation(const MemoryAllocation& allocation, const std::uint32_t heap_index);
+            void RecordFree(const MemoryAllocation& allocation, const std::uint32_t heap_index);
+            void RecordBlockAllocation(const std::uint32_t memory_type_index, const std::uint32_t heap_index, const VkDeviceSize size);
+            void RecordBlockFree(const std::uint32_t memory_type_index, const std::uint32_t heap_index, const VkDeviceSize size);
+
+            AllocationStatistics GetTotalStatistics() const;
+            AllocationStatistics GetMemoryTypeStatistics(const std::uint32_t memory_type_index) const;
+            AllocationStatistics GetHeapStatistics(const std::uint32_t heap_index) const;
+            std::map<std::string, AllocationStatistics> GetTagStatistics() const;
+
+            // Rates since the tracker was created.
+            AllocationRates GetLifetimeRates() const;
+            // Rates since the previous call, so periodic sampling shows bursts and growth.
+            AllocationRates SampleRates();
+
+            void WriteJson(std::ostream& stream) const;
+
+        private:
+            using Clock = std::chrono::steady_clock;
+
+            static void AddAllocation(AllocationStatistics& statistics, const VkDeviceSize size);
+            static void RemoveAllocation(AllocationStatistics& statistics, const VkDeviceSize size);
+            static void AddBlock(AllocationStatistics& statistics, const VkDeviceSize size);
+            static void RemoveBlock(AllocationStatistics& statistics, const VkDeviceSize size);
+            static AllocationRates ComputeRates(
+                const std::uint64_t     allocations,
+                const std::uint64_t     frees,
+                const Clock::duration   duration);
+
+            const Clock::time_point start_time;
+
+            AllocationStatistics                        total;
+            AllocationStatistics                        memory_types[VK_MAX_MEMORY_TYPES];
+            AllocationStatistics                        heaps[VK_MAX_MEMORY_HEAPS];
+            std::map<std::string, AllocationStatistics> tags;
+
+            std::uint64_t       allocation_count = 0u;
+            std::uint64_t       free_count = 0u;
+            Clock::time_point   sample_time;
+            std::uint64_t       sample_allocation_count = 0u;
+            std::uint64_t       sample_free_count = 0u;
+
+            mutable std::mutex  mutex;
+        };
+    }
+}
@@ -0,0 +1,471 @@
+#include "allocator.h"
+
+#include <fstream>
+#include <iterator>
+
+#include <utils/align.h>
+#include <utils/environment.h>
+#include <vulkan/exception.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+MemoryBlock::MemoryBlock(
+    VkDevice            vk_device,
+    const std::uint32_t memory_type_index,
+    const VkDeviceSize  size,
+    const bool          dedicated,
+    const bool          host_visible,
+    const ResourceTiling tiling) :
+    vk_device(vk_device),
+    size(size),
+    dedicated(dedicated),
+    tiling(tiling)
+{
+    VkMemoryAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.allocationSize = size;
+    allocate_info.memoryTypeIndex = memory_type_index;
+    if (vkAllocateMemory(vk_device, &allocate_info, nullptr, &vk_memory) != VK_SUCCESS)
+    {
+        throw Exception("Cannot allocate device memory block");
+    }
+    if (host_visible && vkMapMemory(vk_device, vk_memory, 0u, VK_WHOLE_SIZE, 0u, &mapped_data) != VK_SUCCESS)
+    {
+        vkFreeMemory(vk_device, vk_memory, nullptr);
+        throw Exception("Failed to map host buffer memory");
+    }
+    InsertFreeRange(0u, size);
+}
+
+MemoryBlock::~MemoryBlock()
+{
+    if (mapped_data != nullptr)
+    {
+        vkUnmapMemory(vk_device, vk_memory);
+    }
+    vkFreeMemory(vk_device, vk_memory, nullptr);
+}
+
+bool MemoryBlock::Allocate(const VkDeviceSize requested_size, const VkDeviceSize alignment, VkDeviceSize& offset)
+{
+    // Best fit: start from the smallest range that could hold the request and
+    // walk up until the alignment padding also fits.
+    auto candidate = free_ranges_by_size.lower_bound(requested_size);
+    for (; candidate != free_ranges_by_size.end(); ++candidate)
+    {
+        const VkDeviceSize range_offset = candidate->second;
+        const VkDeviceSize range_size = candidate->first;
+        const VkDeviceSize aligned_offset = utils::AlignUp(range_offset, alignment);
+        if (aligned_offset + requested_size <= range_offset + range_size)
+        {
+            EraseFreeRange(free_ranges_by_offset.find(range_offset));
+            if (aligned_offset != range_offset)
+            {
+                InsertFreeRange(range_offset, aligned_offset - range_offset);
+            }
+            const VkDeviceSize tail_offset = aligned_offset + requested_size;
+            if (tail_offset != range_offset + range_size)
+            {
+                InsertFreeRange(tail_offset, range_offset + range_size - tail_offset);
+            }
+            allocated_size += requested_size;
+            offset = aligned_offset;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MemoryBlock::Free(VkDeviceSize offset, VkDeviceSize freed_size)
+{
+    assert(allocated_size >= freed_size);
+    allocated_size -= freed_size;
+
+    auto next = free_ranges_by_offset.lower_bound(offset);
+    if (next != free_ranges_by_offset.end() && offset + freed_size == next->first)
+    {
+        freed_size += next->second;
+        EraseFreeRange(next);
+    }
+
+    auto next_after_merge = free_ranges_by_offset.lower_bound(offset);
+    if (next_after_merge != free_ranges_by_offset.begin())
+    {
+        auto previous = std::prev(next_after_merge);
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            freed_size += previous->second;
+            EraseFreeRange(previous);
+        }
+    }
+
+    InsertFreeRange(offset, freed_size);
+}
+
+bool MemoryBlock::IsEmpty() const
+{
+    return allocated_size == 0u;
+}
+
+bool MemoryBlock::IsDedicated() const
+{
+    return dedicated;
+}
+
+ResourceTiling MemoryBlock::GetTiling() const
+{
+    return tiling;
+}
+
+VkDeviceSize MemoryBlock::GetSize() const
+{
+    return size;
+}
+
+VkDeviceMemory MemoryBlock::GetMemoryHandle() const
+{
+    return vk_memory;
+}
+
+void* MemoryBlock::GetMappedData() const
+{
+    return mapped_data;
+}
+
+void MemoryBlock::InsertFreeRange(const VkDeviceSize offset, const VkDeviceSize range_size)
+{
+    free_ranges_by_offset.emplace(offset, range_size);
+    free_ranges_by_size.emplace(range_size, offset);
+}
+
+void MemoryBlock::EraseFreeRange(const FreeRanges::iterator range)
+{
+    assert(range != free_ranges_by_offset.end());
+    auto same_size_ranges = free_ranges_by_size.equal_range(range->second);
+    for (auto it = same_size_ranges.first; it != same_size_ranges.second; ++it)
+    {
+        if (it->second == range->first)
+        {
+            free_ranges_by_size.erase(it);
+            break;
+        }
+    }
+    free_ranges_by_offset.erase(range);
+}
+
+
+
+MemoryAllocator::MemoryAllocator(
+    VkDevice            vk_device,
+    VkPhysicalDevice    physical_device,
+    const VkDeviceSize  non_coherent_atom_size,
+    const bool          memory_budget_supported) :
+    vk_device(vk_device),
+    physical_device(physical_device),
+    non_coherent_atom_size(non_coherent_atom_size),
+    memory_budget_supported(memory_budget_supported),
+    statistics_path(utils::ReadEnvironmentVariable(StatisticsPathVariable))
+{
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+    if (!statistics_path.empty())
+    {
+        std::ofstream statistics_file(statistics_path);
+        tracker.WriteJson(statistics_file);
+    }
+
+    for (auto& memory_type_blocks : blocks)
+    {
+        memory_type_blocks.clear();
+    }
+}
+
+MemoryAllocation MemoryAllocator::Allocate(
+    const VkMemoryRequirements&     memory_requirements,
+    const VkMemoryPropertyFlags     required_properties,
+    const MemoryUsage               usage,
+    const ResourceTiling            tiling,
+    const char*                     tag)
+{
+    const std::vector<std::uint32_t> memory_type_indices =
+        FindMemoryTypeIndices(memory_requirements.memoryTypeBits, required_properties, usage);
+    if (memory_type_indices.empty())
+    {
+        throw Exception("Cannot find a memory type with requested properties");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryAllocation allocation;
+    allocation.tag = tag;
+    for (const std::uint32_t memory_type_index : memory_type_indices)
+    {
+        if (TryAllocate(memory_requirements, memory_type_index, tiling, allocation))
+        {
+            tracker.RecordAllocation(allocation, GetHeapIndex(memory_type_index));
+            return allocation;
+        }
+    }
+    throw Exception("Not enough memory budget left in the heaps suitable for the requested memory");
+}
+
+void MemoryAllocator::Free(const MemoryAllocation& allocation)
+{
+    assert(allocation.block != nullptr);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    tracker.RecordFree(allocation, GetHeapIndex(allocation.memory_type_index));
+
+    MemoryBlock* block = allocation.block;
+    block->Free(allocation.offset, allocation.size);
+    if (!block->IsEmpty())
+        return;
+
+    // Keep one empty shared block per memory type and tiling around to avoid
+    // allocate/free churn when a single resource is recreated.
+    auto& memory_type_blocks = blocks[allocation.memory_type_index];
+    const auto shared_block_count = std::count_if(memory_type_blocks.cbegin(), memory_type_blocks.cend(),
+        [block](const std::unique_ptr<MemoryBlock>& b)
+    {
+        return !b->IsDedicated() && b->GetTiling() == block->GetTiling();
+    });
+    if (block->IsDedicated() || shared_block_count > 1)
+    {
+        heap_allocated_bytes[GetHeapIndex(allocation.memory_type_index)] -= block->GetSize();
+        tracker.RecordBlockFree(allocation.memory_type_index, GetHeapIndex(allocation.memory_type_index), block->GetSize());
+        memory_type_blocks.erase(std::find_if(memory_type_blocks.begin(), memory_type_blocks.end(),
+            [block](const std::unique_ptr<MemoryBlock>& b)
+        {
+            return b.get() == block;
+        }));
+    }
+}
+
+std::vector<std::uint32_t> MemoryAllocator::FindMemoryTypeIndices(
+    const std::uint32_t             memory_type_bits,
+    const VkMemoryPropertyFlags     required_properties,
+    const MemoryUsage               usage) const
+{
+    // Lazily allocated and protected memory is only usable by resources that ask for it explicitly.
+    const VkMemoryPropertyFlags special_properties =
+        (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT) & ~required_properties;
+
+    std::vector<std::pair<int, std::uint32_t>> scored_indices;
+    for (std::uint32_t index = 0u; index != memory_properties.memoryTypeCount; ++index)
+    {
+        const VkMemoryPropertyFlags flags = memory_properties.memoryTypes[index].propertyFlags;
+        if ((memory_type_bits & (1u << index)) == 0u ||
+            (flags & required_properties) != required_properties ||
+            (flags & special_properties) != 0u)
+        {
+            continue;
+        }
+
+        const bool device_local = (flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) != 0u;
+        const bool host_visible = (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0u;
+        const bool host_coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+        const bool host_cached = (flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT) != 0u;
+
+        int score = 0;
+        switch (usage)
+        {
+        case MemoryUsage::DeviceOnly:
+            // Leave host-visible device memory (ReBAR) to the resources written by the host.
+            score += device_local ? 8 : 0;
+            score -= host_visible ? 2 : 0;
+            break;
+        case MemoryUsage::Upload:
+            // Uncached write-combined memory is the fastest for streaming writes.
+            score += host_coherent ? 4 : 0;
+            score -= device_local ? 2 : 0;
+            score -= host_cached ? 1 : 0;
+            break;
+        case MemoryUsage::Readback:
+            score += host_cached ? 8 : 0;
+            score += host_coherent ? 2 : 0;
+            score -= device_local ? 1 : 0;
+            break;
+        case MemoryUsage::DeviceWithHostWrite:
+            score += device_local ? 8 : 0;
+            score += host_coherent ? 2 : 0;
+            break;
+        }
+        scored_indices.emplace_back(score, index);
+    }
+
+    std::stable_sort(scored_indices.begin(), scored_indices.end(),
+        [](const std::pair<int, std::uint32_t>& a, const std::pair<int, std::uint32_t>& b)
+    {
+        return a.first > b.first;
+    });
+
+    std::vector<std::uint32_t> memory_type_indices;
+    memory_type_indices.reserve(scored_indices.size());
+    for (const auto& scored_index : scored_indices)
+    {
+        memory_type_indices.push_back(scored_index.second);
+    }
+    return memory_type_indices;
+}
+
+AllocationTracker& MemoryAllocator::GetTracker()
+{
+    return tracker;
+}
+
+const AllocationTracker& MemoryAllocator::GetTracker() const
+{
+    return tracker;
+}
+
+const VkPhysicalDeviceMemoryProperties& MemoryAllocator::GetMemoryProperties() const
+{
+    return memory_properties;
+}
+
+MemoryAllocator::HeapBudget MemoryAllocator::GetHeapBudget(const std::uint32_t heap_index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return QueryHeapBudget(heap_index);
+}
+
+std::size_t MemoryAllocator::GetDeviceMemoryCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::size_t count = 0u;
+    for (const auto& memory_type_blocks : blocks)
+    {
+        count += memory_type_blocks.size();
+    }
+    return count;
+}
+
+bool MemoryAllocator::TryAllocate(
+    const VkMemoryRequirements&     resource_memory_requirements,
+    const std::uint32_t             memory_type_index,
+    const ResourceTiling            tiling,
+    MemoryAllocation&               allocation)
+{
+    auto& memory_type_blocks = blocks[memory_type_index];
+
+    // Flushes and invalidations work on whole atoms, so resources in non-coherent
+    // memory must not share an atom with their neighbours.
+    VkMemoryRequirements memory_requirements = resource_memory_requirements;
+    if (IsHostVisible(memory_type_index) && !IsHostCoherent(memory_type_index))
+    {
+        memory_requirements.alignment = std::max(memory_requirements.alignment, non_coherent_atom_size);
+        memory_requirements.size = utils::AlignUp(memory_requirements.size, non_coherent_atom_size);
+    }
+
+    allocation.size = memory_requirements.size;
+    allocation.memory_type_index = memory_type_index;
+
+    // Large resources would only fragment the shared blocks, give them their own memory.
+    const VkDeviceSize block_size = GetBlockSize(memory_type_index);
+    const bool dedicated = memory_requirements.size > block_size / 2u;
+    if (!dedicated)
+    {
+        for (const auto& block : memory_type_blocks)
+        {
+            if (!block->IsDedicated() &&
+                block->GetTiling() == tiling &&
+                block->Allocate(memory_requirements.size, memory_requirements.alignment, allocation.offset))
+            {
+                FillAllocation(allocation, block.get());
+                return true;
+            }
+        }
+    }
+
+    const std::uint32_t heap_index = GetHeapIndex(memory_type_index);
+    const VkDeviceSize new_block_size = dedicated ? memory_requirements.size : block_size;
+    const HeapBudget heap_budget = QueryHeapBudget(heap_index);
+    if (heap_budget.usage + new_block_size > heap_budget.budget)
+    {
+        return false;
+    }
+
+    try
+    {
+        memory_type_blocks.push_back(std::make_unique<MemoryBlock>(
+            vk_device, memory_type_index, new_block_size, dedicated, IsHostVisible(memory_type_index), tiling));
+    }
+    catch (const Exception&)
+    {
+        return false;
+    }
+    heap_allocated_bytes[heap_index] += new_block_size;
+    tracker.RecordBlockAllocation(memory_type_index, heap_index, new_block_size);
+
+    MemoryBlock* block = memory_type_blocks.back().get();
+    if (!block->Allocate(memory_requirements.size, memory_requirements.alignment, allocation.offset))
+    {
+        throw Exception("Cannot sub-allocate device memory");
+    }
+    FillAllocation(allocation, block);
+    return true;
+}
+
+MemoryAllocator::HeapBudget MemoryAllocator::QueryHeapBudget(const std::uint32_t heap_index) const
+{
+    HeapBudget heap_budget;
+    if (memory_budget_supported)
+    {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+        budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 memory_properties_2 = {};
+        memory_properties_2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        memory_properties_2.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(physical_device, &memory_properties_2);
+        heap_budget.budget = budget_properties.heapBudget[heap_index];
+        heap_budget.usage = budget_properties.heapUsage[heap_index];
+    }
+    else
+    {
+        // Without the extension only our own allocations are known, keep some headroom for everyone else.
+        heap_budget.budget = memory_properties.memoryHeaps[heap_index].size / 10u * 8u;
+        heap_budget.usage = heap_allocated_bytes[heap_index];
+    }
+    return heap_budget;
+}
+
+VkDeviceSize MemoryAllocator::GetBlockSize(const std::uint32_t memory_type_index) const
+{
+    const VkDeviceSize heap_size = memory_properties.memoryHeaps[GetHeapIndex(memory_type_index)].size;
+    return std::max<VkDeviceSize>(std::min<VkDeviceSize>(DefaultBlockSize, heap_size / 8u), MinBlockSize);
+}
+
+std::uint32_t MemoryAllocator::GetHeapIndex(const std::uint32_t memory_type_index) const
+{
+    return memory_properties.memoryTypes[memory_type_index].heapIndex;
+}
+
+bool MemoryAllocator::IsHostVisible(const std::uint32_t memory_type_index) const
+{
+    return (memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0u;
+}
+
+bool MemoryAllocator::IsHostCoherent(const std::uint32_t memory_type_index) const
+{
+    return (memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+}
+
+void MemoryAllocator::FillAllocation(MemoryAllocation& allocation, MemoryBlock* block) const
+{
+    allocation.property_flags = memory_properties.memoryTypes[allocation.memory_type_index].propertyFlags;
+    allocation.block = block;
+    allocation.vk_memory = block->GetMemoryHandle();
+    allocation.mapped_data = (block->GetMappedData() == nullptr) ?
+        nullptr :
+        static_cast<std::uint8_t*>(block->GetMappedData()) + allocation.offset;
+}
+
+}
+}
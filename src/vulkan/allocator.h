@@ -0,0 +1,186 @@
+#pragma once
+
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vulkan/allocation_tracker.h>
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        class MemoryBlock;
+
+
+        // Linear (buffers, linear images) and optimal (tiled images) resources never share a block,
+        // so bufferImageGranularity does not have to be honoured between neighbours.
+        enum class ResourceTiling
+        {
+            Linear,
+            Optimal,
+        };
+
+
+        struct MemoryAllocation
+        {
+            VkDeviceMemory  vk_memory = VK_NULL_HANDLE;
+            VkDeviceSize    offset = 0u;
+            VkDeviceSize    size = 0u;
+            std::uint32_t   memory_type_index = ~0u;
+            MemoryBlock*    block = nullptr;
+            void*           mapped_data = nullptr; // nullptr unless the memory is host visible
+            const char*     tag = nullptr; // Statistics group, must outlive the allocation
+
+            VkMemoryPropertyFlags property_flags = 0u;
+
+            bool IsHostCoherent() const
+            {
+                return (property_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+            }
+        };
+
+
+        // A single VkDeviceMemory page that is split between several resources.
+        // Host-visible blocks stay mapped for their whole lifetime.
+        class MemoryBlock
+        {
+        public:
+            explicit MemoryBlock(
+                VkDevice            vk_device,
+                const std::uint32_t memory_type_index,
+                const VkDeviceSize  size,
+                const bool          dedicated,
+                const bool          host_visible,
+                const ResourceTiling tiling);
+            MemoryBlock(const MemoryBlock& other) = delete;
+            ~MemoryBlock();
+
+            bool Allocate(const VkDeviceSize size, const VkDeviceSize alignment, VkDeviceSize& offset);
+            void Free(const VkDeviceSize offset, const VkDeviceSize size);
+
+            bool IsEmpty() const;
+            bool IsDedicated() const;
+            ResourceTiling GetTiling() const;
+            VkDeviceSize GetSize() const;
+            VkDeviceMemory GetMemoryHandle() const;
+            void* GetMappedData() const;
+
+        private:
+            using FreeRanges = std::map<VkDeviceSize, VkDeviceSize>;
+
+            void InsertFreeRange(const VkDeviceSize offset, const VkDeviceSize size);
+            void EraseFreeRange(const FreeRanges::iterator range);
+
+            const VkDevice      vk_device;
+            const VkDeviceSize  size;
+            const bool          dedicated;
+            const ResourceTiling tiling;
+            VkDeviceMemory      vk_memory = VK_NULL_HANDLE;
+            VkDeviceSize        allocated_size = 0u;
+
+            // Free ranges are indexed both by offset (to coalesce neighbours on free)
+            // and by size (to find the best fitting range on allocation).
+            FreeRanges                                  free_ranges_by_offset;
+            std::multimap<VkDeviceSize, VkDeviceSize>   free_ranges_by_size;
+
+            void*               mapped_data = nullptr;
+        };
+
+
+        // How a resource is accessed, used to rank the memory types that satisfy its requirements.
+        enum class MemoryUsage
+        {
+            DeviceOnly,             // Never accessed by the host
+            Upload,                 // Written by the host, read by the device once or twice
+            Readback,               // Written by the device, read by the host
+            DeviceWithHostWrite,    // Read by the device often, written directly by the host
+        };
+
+
+        // Sub-allocates buffer and image memory from large per-type blocks, so the number of live
+        // vkAllocateMemory objects grows with the number of blocks rather than with the number of
+        // resources (see GetDeviceMemoryCount). Allocation latency has not been benchmarked.
+        class MemoryAllocator
+        {
+        public:
+            explicit MemoryAllocator(
+                VkDevice            vk_device,
+                VkPhysicalDevice    physical_device,
+                const VkDeviceSize  non_coherent_atom_size,
+                const bool          memory_budget_supported);
+            MemoryAllocator(const MemoryAllocator& other) = delete;
+            ~MemoryAllocator();
+
+            enum : VkDeviceSize
+            {
+                DefaultBlockSize = 64ull * 1024ull * 1024ull,
+                MinBlockSize = 1ull * 1024ull * 1024ull,
+            };
+
+            struct HeapBudget
+            {
+                VkDeviceSize budget = 0u;
+                VkDeviceSize usage = 0u;
+            };
+
+            // Picks the best memory type for the usage that still has budget left in its heap.
+            MemoryAllocation Allocate(
+                const VkMemoryRequirements&     memory_requirements,
+                const VkMemoryPropertyFlags     required_properties,
+                const MemoryUsage               usage,
+                const ResourceTiling            tiling = ResourceTiling::Linear,
+                const char*                     tag = nullptr);
+            void Free(const MemoryAllocation& allocation);
+
+            // Memory types compatible with the requirements, best match first.
+            std::vector<std::uint32_t> FindMemoryTypeIndices(
+                const std::uint32_t             memory_type_bits,
+                const VkMemoryPropertyFlags     required_properties,
+                const MemoryUsage               usage) const;
+
+            const VkPhysicalDeviceMemoryProperties& GetMemoryProperties() const;
+            HeapBudget GetHeapBudget(const std::uint32_t heap_index) const;
+
+            // Number of live vkAllocateMemory objects owned by the allocator.
+            std::size_t GetDeviceMemoryCount() const;
+
+            AllocationTracker& GetTracker();
+            const AllocationTracker& GetTracker() const;
+
+            // Environment variable naming a file the statistics are written to when the allocator is destroyed.
+            static constexpr const char* StatisticsPathVariable = "CT_MEMORY_STATISTICS_PATH";
+
+        private:
+            bool TryAllocate(
+                const VkMemoryRequirements&     memory_requirements,
+                const std::uint32_t             memory_type_index,
+                const ResourceTiling            tiling,
+                MemoryAllocation&               allocation);
+            HeapBudget QueryHeapBudget(const std::uint32_t heap_index) const;
+            VkDeviceSize GetBlockSize(const std::uint32_t memory_type_index) const;
+            std::uint32_t GetHeapIndex(const std::uint32_t memory_type_index) const;
+            bool IsHostVisible(const std::uint32_t memory_type_index) const;
+            bool IsHostCoherent(const std::uint32_t memory_type_index) const;
+            void FillAllocation(MemoryAllocation& allocation, MemoryBlock* block) const;
+
+            const VkDevice                      vk_device;
+            const VkPhysicalDevice              physical_device;
+            const VkDeviceSize                  non_coherent_atom_size;
+            const bool                          memory_budget_supported;
+            VkPhysicalDeviceMemoryProperties    memory_properties;
+
+            std::vector<std::unique_ptr<MemoryBlock>>   blocks[VK_MAX_MEMORY_TYPES];
+            VkDeviceSize                                heap_allocated_bytes[VK_MAX_MEMORY_HEAPS] = {};
+            mutable std::mutex                          mutex;
+
+            AllocationTracker                           tracker;
+            const std::string                           statistics_path;
+        };
+    }
+}
@@ -0,0 +1,237 @@
+#include "barrier_batch.h"
+
+
+#include <algorithm>
+
+
+namespace
+{
+    bool IsSameRange(const VkImageSubresourceRange& a, const VkImageSubresourceRange& b)
+    {
+        return a.aspectMask == b.aspectMask &&
+            a.baseMipLevel == b.baseMipLevel &&
+            a.levelCount == b.levelCount &&
+            a.baseArrayLayer == b.baseArrayLayer &&
+            a.layerCount == b.layerCount;
+    }
+
+    bool HasWrites(const VkAccessFlags access)
+    {
+        return (access & ct::vulkan::BarrierBatch::WriteAccessMask) != 0u;
+    }
+
+    template <typename Barrier>
+    bool IsOwnershipTransfer(const Barrier& barrier)
+    {
+        return barrier.srcQueueFamilyIndex != barrier.dstQueueFamilyIndex;
+    }
+}
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+constexpr VkAccessFlags BarrierBatch::WriteAccessMask;
+
+void BarrierBatch::AddImageBarrier(
+    const VkImage                   image,
+    const VkImageSubresourceRange&  subresource_range,
+    const VkImageLayout             old_layout,
+    const VkAccessFlags             source_access,
+    const VkPipelineStageFlags      barrier_source_stages,
+    const VkImageLayout             new_layout,
+    const VkAccessFlags             destination_access,
+    const VkPipelineStageFlags      barrier_destination_stages)
+{
+    if (old_layout == new_layout && !HasWrites(source_access) && !HasWrites(destination_access))
+    {
+        ++dropped_count;
+        return;
+    }
+
+    // No command is recorded between queued barriers, so A->B followed by B->C is just A->C.
+    auto pending = std::find_if(image_barriers.begin(), image_barriers.end(),
+        [image, &subresource_range](const VkImageMemoryBarrier& barrier)
+    {
+        return barrier.image == image && IsSameRange(barrier.subresourceRange, subresource_range) && !IsOwnershipTransfer(barrier);
+    });
+    if (pending != image_barriers.end() && pending->newLayout == old_layout)
+    {
+        ++merged_count;
+        pending->newLayout = new_layout;
+        pending->dstAccessMask = destination_access;
+        destination_stages |= barrier_destination_stages;
+        if (pending->oldLayout == pending->newLayout && !HasWrites(pending->srcAccessMask) && !HasWrites(destination_access))
+        {
+            image_barriers.erase(pending);
+            ++dropped_count;
+        }
+        return;
+    }
+
+    VkImageMemoryBarrier image_memory_barrier = {};
+    image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_memory_barrier.srcAccessMask = source_access;
+    image_memory_barrier.dstAccessMask = destination_access;
+    image_memory_barrier.oldLayout = old_layout;
+    image_memory_barrier.newLayout = new_layout;
+    image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_memory_barrier.image = image;
+    image_memory_barrier.subresourceRange = subresource_range;
+    image_barriers.push_back(image_memory_barrier);
+
+    source_stages |= barrier_source_stages;
+    destination_stages |= barrier_destination_stages;
+}
+
+void BarrierBatch::AddBufferBarrier(
+    const VkBuffer                  buffer,
+    const VkDeviceSize              offset,
+    const VkDeviceSize              size,
+    const VkAccessFlags             source_access,
+    const VkPipelineStageFlags      barrier_source_stages,
+    const VkAccessFlags             destination_access,
+    const VkPipelineStageFlags      barrier_destination_stages)
+{
+    // Without a write on either side there is no hazard to guard against.
+    if (!HasWrites(source_access) && !HasWrites(destination_access))
+    {
+        ++dropped_count;
+        return;
+    }
+
+    auto pending = std::find_if(buffer_barriers.begin(), buffer_barriers.end(),
+        [buffer, offset, size](const VkBufferMemoryBarrier& barrier)
+    {
+        return barrier.buffer == buffer && barrier.offset == offset && barrier.size == size && !IsOwnershipTransfer(barrier);
+    });
+    if (pending != buffer_barriers.end())
+    {
+        ++merged_count;
+        pending->srcAccessMask |= source_access;
+        pending->dstAccessMask |= destination_access;
+    }
+    else
+    {
+        VkBufferMemoryBarrier buffer_memory_barrier = {};
+        buffer_memory_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        buffer_memory_barrier.srcAccessMask = source_access;
+        buffer_memory_barrier.dstAccessMask = destination_access;
+        buffer_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        buffer_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        buffer_memory_barrier.buffer = buffer;
+        buffer_memory_barrier.offset = offset;
+        buffer_memory_barrier.size = size;
+        buffer_barriers.push_back(buffer_memory_barrier);
+    }
+
+    source_stages |= barrier_source_stages;
+    destination_stages |= barrier_destination_stages;
+}
+
+void BarrierBatch::AddImageOwnershipTransfer(
+    const VkImage                   image,
+    const VkImageSubresourceRange&  subresource_range,
+    const VkImageLayout             layout,
+    const std::uint32_t             source_family_index,
+    const std::uint32_t             destination_family_index,
+    const VkAccessFlags             source_access,
+    const VkPipelineStageFlags      barrier_source_stages,
+    const VkAccessFlags             destination_access,
+    const VkPipelineStageFlags      barrier_destination_stages)
+{
+    assert(source_family_index != destination_family_index);
+    VkImageMemoryBarrier image_memory_barrier = {};
+    image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_memory_barrier.srcAccessMask = source_access;
+    image_memory_barrier.dstAccessMask = destination_access;
+    image_memory_barrier.oldLayout = layout;
+    image_memory_barrier.newLayout = layout;
+    image_memory_barrier.srcQueueFamilyIndex = source_family_index;
+    image_memory_barrier.dstQueueFamilyIndex = destination_family_index;
+    image_memory_barrier.image = image;
+    image_memory_barrier.subresourceRange = subresource_range;
+    image_barriers.push_back(image_memory_barrier);
+
+    source_stages |= barrier_source_stages;
+    destination_stages |= barrier_destination_stages;
+}
+
+void BarrierBatch::AddBufferOwnershipTransfer(
+    const VkBuffer                  buffer,
+    const std::uint32_t             source_family_index,
+    const std::uint32_t             destination_family_index,
+    const VkAccessFlags             source_access,
+    const VkPipelineStageFlags      barrier_source_stages,
+    const VkAccessFlags             destination_access,
+    const VkPipelineStageFlags      barrier_destination_stages)
+{
+    assert(source_family_index != destination_family_index);
+    VkBufferMemoryBarrier buffer_memory_barrier = {};
+    buffer_memory_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_memory_barrier.srcAccessMask = source_access;
+    buffer_memory_barrier.dstAccessMask = destination_access;
+    buffer_memory_barrier.srcQueueFamilyIndex = source_family_index;
+    buffer_memory_barrier.dstQueueFamilyIndex = destination_family_index;
+    buffer_memory_barrier.buffer = buffer;
+    buffer_memory_barrier.offset = 0u;
+    buffer_memory_barrier.size = VK_WHOLE_SIZE;
+    buffer_barriers.push_back(buffer_memory_barrier);
+
+    source_stages |= barrier_source_stages;
+    destination_stages |= barrier_destination_stages;
+}
+
+bool BarrierBatch::IsEmpty() const
+{
+    return image_barriers.empty() && buffer_barriers.empty();
+}
+
+void BarrierBatch::Flush(const VkCommandBuffer command_buffer)
+{
+    if (IsEmpty())
+    {
+        source_stages = 0u;
+        destination_stages = 0u;
+        return;
+    }
+
+    vkCmdPipelineBarrier(
+        command_buffer,
+        (source_stages != 0u) ? source_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT),
+        (destination_stages != 0u) ? destination_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT),
+        0,
+        0,
+        nullptr,
+        static_cast<std::uint32_t>(buffer_barriers.size()),
+        buffer_barriers.data(),
+        static_cast<std::uint32_t>(image_barriers.size()),
+        image_barriers.data());
+    ++flush_count;
+
+    image_barriers.clear();
+    buffer_barriers.clear();
+    source_stages = 0u;
+    destination_stages = 0u;
+}
+
+std::size_t BarrierBatch::GetFlushCount() const
+{
+    return flush_count;
+}
+
+std::size_t BarrierBatch::GetMergedCount() const
+{
+    return merged_count;
+}
+
+std::size_t BarrierBatch::GetDroppedCount() const
+{
+    return dropped_count;
+}
+
+}
+}
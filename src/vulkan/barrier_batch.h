@@ -0,0 +1,88 @@
+#pragma once
+
+
+#include <cstddef>
+#include <vector>
+
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        // Collects pipeline barriers until the next command that depends on them and records them
+        // all with one vkCmdPipelineBarrier. Transitions of the same resource queued back to back are
+        // folded into one, and barriers that order nothing (read after read in the same layout) are dropped.
+        class BarrierBatch
+        {
+        public:
+            void AddImageBarrier(
+                const VkImage                   image,
+                const VkImageSubresourceRange&  subresource_range,
+                const VkImageLayout             old_layout,
+                const VkAccessFlags             source_access,
+                const VkPipelineStageFlags      source_stages,
+                const VkImageLayout             new_layout,
+                const VkAccessFlags             destination_access,
+                const VkPipelineStageFlags      destination_stages);
+
+            void AddBufferBarrier(
+                const VkBuffer                  buffer,
+                const VkDeviceSize              offset,
+                const VkDeviceSize              size,
+                const VkAccessFlags             source_access,
+                const VkPipelineStageFlags      source_stages,
+                const VkAccessFlags             destination_access,
+                const VkPipelineStageFlags      destination_stages);
+
+            // Release or acquire half of a queue family ownership transfer. These are recorded as given:
+            // the two halves must match exactly, so they are never merged with other barriers.
+            void AddImageOwnershipTransfer(
+                const VkImage                   image,
+                const VkImageSubresourceRange&  subresource_range,
+                const VkImageLayout             layout,
+                const std::uint32_t             source_family_index,
+                const std::uint32_t             destination_family_index,
+                const VkAccessFlags             source_access,
+                const VkPipelineStageFlags      source_stages,
+                const VkAccessFlags             destination_access,
+                const VkPipelineStageFlags      destination_stages);
+
+            void AddBufferOwnershipTransfer(
+                const VkBuffer                  buffer,
+                const std::uint32_t             source_family_index,
+                const std::uint32_t             destination_family_index,
+                const VkAccessFlags             source_access,
+                const VkPipelineStageFlags      source_stages,
+                const VkAccessFlags             destination_access,
+                const VkPipelineStageFlags      destination_stages);
+
+            bool IsEmpty() const;
+            void Flush(const VkCommandBuffer command_buffer);
+
+            // Access masks that make a barrier necessary even without a layout change.
+            static constexpr VkAccessFlags WriteAccessMask =
+                VK_ACCESS_SHADER_WRITE_BIT |
+                VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                VK_ACCESS_TRANSFER_WRITE_BIT |
+                VK_ACCESS_HOST_WRITE_BIT |
+                VK_ACCESS_MEMORY_WRITE_BIT;
+
+            std::size_t GetFlushCount() const;
+            std::size_t GetMergedCount() const;
+            std::size_t GetDroppedCount() const;
+
+        private:
+            std::vector<VkImageMemoryBarrier>   image_barriers;
+            std::vector<VkBufferMemoryBarrier>  buffer_barriers;
+            VkPipelineStageFlags                source_stages = 0u;
+            VkPipelineStageFlags                destination_stages = 0u;
+
+            std::size_t                         flush_count = 0u;
+            std::size_t                         merged_count = 0u;
+            std::size_t                         dropped_count = 0u;
+        };
+    }
+}
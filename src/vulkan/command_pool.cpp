@@ -1,8 +1,11 @@
 #include "command_pool.h"
 
 
+#include <algorithm>
+
 #include <vulkan/device.h>
 #include <vulkan/exception.h>
+#include <vulkan/pipeline.h>
 #include <vulkan/synchronization.h>
 
 
@@ -11,19 +14,30 @@ namespace ct
 namespace vulkan
 {
 
-CommandPool::CommandPool(const Device& device, QueueType queue_type) :
+CommandPool::CommandPool(const Device& device, QueueType queue_type, const CommandPoolFlags flags) :
     device(device),
-    queue_type(queue_type)
+    queue_type(queue_type),
+    flags(flags),
+    reset_count(0u)
 {
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    pool_info.flags = 0;
+    pool_info.flags = flags;
     pool_info.queueFamilyIndex = device.GetQueueFamilyIndex(queue_type);
 
     if (vkCreateCommandPool(device.GetHandle(), &pool_info, nullptr, &handle) != VK_SUCCESS)
         throw Exception("Failed to create command pool");
 }
 
+CommandPool::CommandPool(CommandPool&& other) :
+    Object<VkCommandPool>(std::move(other)),
+    device(other.device),
+    queue_type(other.queue_type),
+    flags(other.flags),
+    reset_count(other.reset_count)
+{
+}
+
 const Device& CommandPool::GetDevice() const
 {
     return device;
@@ -34,6 +48,11 @@ QueueType CommandPool::GetQueueType() const
     return queue_type;
 }
 
+CommandPoolFlags CommandPool::GetFlags() const
+{
+    return flags;
+}
+
 VkQueue CommandPool::GetQueue() const
 {
     return device.GetQueue(queue_type);
@@ -52,28 +71,86 @@ void CommandPool::Trim() const
     vkTrimCommandPool(device.GetHandle(), handle, 0u);
 }
 
+std::vector<CommandBuffer> CommandPool::AllocateCommandBuffers(
+    const std::uint32_t         count,
+    const CommandBufferLevel    level) const
+{
+    std::vector<VkCommandBuffer> handles(count, VK_NULL_HANDLE);
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool = handle;
+    allocate_info.level = static_cast<VkCommandBufferLevel>(level);
+    allocate_info.commandBufferCount = count;
+    if (count != 0u && vkAllocateCommandBuffers(device.GetHandle(), &allocate_info, handles.data()) != VK_SUCCESS)
+    {
+        throw Exception("Failed to allocate command buffers");
+    }
+
+    std::vector<CommandBuffer> command_buffers;
+    command_buffers.reserve(count);
+    for (const VkCommandBuffer command_buffer_handle : handles)
+    {
+        command_buffers.push_back(CommandBuffer(*this, level, command_buffer_handle));
+    }
+    return command_buffers;
+}
+
+void CommandPool::Reset(const bool release_resources)
+{
+    const VkCommandPoolResetFlags reset_flags = release_resources ?
+        static_cast<VkCommandPoolResetFlags>(VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT) :
+        0u;
+    if (vkResetCommandPool(device.GetHandle(), handle, reset_flags) != VK_SUCCESS)
+    {
+        throw Exception("Failed to reset command pool");
+    }
+    ++reset_count;
+}
+
+std::uint64_t CommandPool::GetResetCount() const
+{
+    return reset_count;
+}
+
 CommandPool::~CommandPool()
 {
-    vkDestroyCommandPool(device.GetHandle(), handle, nullptr);
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(device.GetHandle(), handle, nullptr);
+    }
 }
 
 
 
-CommandBuffer::CommandBuffer(const CommandPool& command_pool) :
+CommandBuffer::CommandBuffer(const CommandPool& command_pool, const CommandBufferLevel level) :
+    command_pool(command_pool),
+    level(level),
     status(Initial),
-    command_pool(command_pool)
+    pool_reset_count(command_pool.GetResetCount())
 {
     VkCommandBufferAllocateInfo allocate_info = {};
     allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocate_info.commandPool = command_pool.GetHandle();
-    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocate_info.commandBufferCount = 1u; // TODO: Allow allocating N instances at once
+    allocate_info.level = static_cast<VkCommandBufferLevel>(level);
+    allocate_info.commandBufferCount = 1u;
     if (vkAllocateCommandBuffers(command_pool.GetDevice().GetHandle(), &allocate_info, &handle) != VK_SUCCESS)
     {
         throw Exception("Failed to allocate command buffers");
     }
 }
 
+CommandBuffer::CommandBuffer(
+    const CommandPool&          command_pool,
+    const CommandBufferLevel    level,
+    const VkCommandBuffer       handle) :
+    command_pool(command_pool),
+    level(level),
+    status(Initial),
+    pool_reset_count(command_pool.GetResetCount())
+{
+    this->handle = handle;
+}
+
 CommandBuffer::~CommandBuffer()
 {
     if (handle != VK_NULL_HANDLE)
@@ -89,7 +166,9 @@ CommandBuffer::~CommandBuffer()
 CommandBuffer::CommandBuffer(CommandBuffer&& other) :
     Object<VkCommandBuffer>(std::move(other)),
     command_pool(other.command_pool),
-    status(other.status)
+    level(other.level),
+    status(other.status),
+    pool_reset_count(other.pool_reset_count)
 {
 }
 
@@ -98,31 +177,44 @@ const CommandPool& CommandBuffer::GetPool() const
     return command_pool;
 }
 
+CommandBufferLevel CommandBuffer::GetLevel() const
+{
+    return level;
+}
+
 void CommandBuffer::Reset()
 {
-    assert(status != Pending);
+    assert(GetStatus() != Pending);
+    assert((command_pool.GetFlags() & ResettableCommandBuffers) != 0u);
     vkResetCommandBuffer(handle, VK_COMMAND_BUFFER_RESET_RELEASE_RESOURCES_BIT);
     status = Initial;
 }
 
 CommandBuffer::Status CommandBuffer::GetStatus() const
 {
-    return status;
+    return (pool_reset_count == command_pool.GetResetCount()) ? status : Initial;
 }
 
-void CommandBuffer::StartRecording()
+void CommandBuffer::StartRecording(const VkCommandBufferInheritanceInfo* inheritance_info)
 {
-    if (status == Initial)
+    if (GetStatus() == Initial)
     {
         VkCommandBufferBeginInfo info = {};
         info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        info.flags = 0;
-        info.pInheritanceInfo = nullptr;
+        info.flags = ((command_pool.GetFlags() & TransientCommandBuffers) != 0u) ?
+            static_cast<VkCommandBufferUsageFlags>(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) :
+            0u;
+        if (inheritance_info != nullptr && inheritance_info->renderPass != VK_NULL_HANDLE)
+        {
+            info.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        }
+        info.pInheritanceInfo = inheritance_info;
         if (vkBeginCommandBuffer(handle, &info) != VK_SUCCESS)
         {
             throw Exception("Failed to begin recording the command buffer");
         }
         status = Recording;
+        pool_reset_count = command_pool.GetResetCount();
     }
     else
     {
@@ -145,46 +237,837 @@ void CommandBuffer::StopRecording()
 
 
 
+FrameCommandPools::FrameCommandPools(
+    const Device&       device,
+    const QueueType     queue_type,
+    const std::uint32_t frames_in_flight) :
+    frame_index(0u)
+{
+    assert(frames_in_flight > 0u);
+    frames.reserve(frames_in_flight);
+    for (std::uint32_t i = 0u; i != frames_in_flight; ++i)
+    {
+        frames.emplace_back(CommandPool(device, queue_type, TransientCommandBuffers));
+    }
+}
+
+void FrameCommandPools::BeginFrame()
+{
+    frame_index = (frame_index + 1u) % static_cast<std::uint32_t>(frames.size());
+    Frame& frame = frames[frame_index];
+    if (frame.fence != nullptr)
+    {
+        frame.fence->Wait();
+        frame.fence = nullptr;
+    }
+    if (frame.used_counts[PrimaryCommandBuffer] != 0u || frame.used_counts[SecondaryCommandBuffer] != 0u)
+    {
+        frame.pool.Reset();
+        frame.used_counts[PrimaryCommandBuffer] = 0u;
+        frame.used_counts[SecondaryCommandBuffer] = 0u;
+    }
+}
+
+void FrameCommandPools::EndFrame(const Fence& fence)
+{
+    frames[frame_index].fence = &fence;
+}
+
+CommandBuffer& FrameCommandPools::AcquireCommandBuffer(const CommandBufferLevel level)
+{
+    Frame& frame = frames[frame_index];
+    std::deque<CommandBuffer>& level_command_buffers = frame.command_buffers[level];
+    std::size_t& used_count = frame.used_counts[level];
+    if (used_count == level_command_buffers.size())
+    {
+        // Grow geometrically so a steady frame allocates nothing after the first few frames.
+        const std::size_t count = std::max<std::size_t>(level_command_buffers.size(), 1u);
+        std::vector<CommandBuffer> command_buffers =
+            frame.pool.AllocateCommandBuffers(static_cast<std::uint32_t>(count), level);
+        for (auto& command_buffer : command_buffers)
+        {
+            level_command_buffers.push_back(std::move(command_buffer));
+        }
+    }
+    return level_command_buffers[used_count++];
+}
+
+const CommandPool& FrameCommandPools::GetCurrentPool() const
+{
+    return frames[frame_index].pool;
+}
+
+
+
 CommandRecorder::CommandRecorder(CommandBuffer& command_buffer) : command_buffer(command_buffer)
 {
-    command_buffer.StartRecording();
+    if (command_buffer.GetLevel() == SecondaryCommandBuffer)
+    {
+        // Secondary command buffers always need inheritance info, even outside of a render pass.
+        VkCommandBufferInheritanceInfo inheritance_info = {};
+        inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        command_buffer.StartRecording(&inheritance_info);
+    }
+    else
+    {
+        command_buffer.StartRecording(nullptr);
+    }
+}
+
+CommandRecorder::CommandRecorder(CommandBuffer& command_buffer, const CommandBufferInheritance& inheritance) :
+    command_buffer(command_buffer)
+{
+    assert(command_buffer.GetLevel() == SecondaryCommandBuffer);
+    VkCommandBufferInheritanceInfo inheritance_info = {};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = inheritance.render_pass;
+    inheritance_info.subpass = inheritance.subpass;
+    inheritance_info.framebuffer = inheritance.framebuffer;
+    command_buffer.StartRecording(&inheritance_info);
 }
 
 CommandRecorder::~CommandRecorder()
 {
+    FlushBarriers();
     command_buffer.StopRecording();
 }
-        
 
-void DoSubmitCommands(
-    VkSubmitInfo&           submit_info,
-    const CommandBuffer&    command_buffer,
-    const Semaphore*        signal_semaphore_ptr)
+void CommandRecorder::ExecuteCommands(const CommandBuffer& secondary_command_buffer)
+{
+    assert(secondary_command_buffer.GetLevel() == SecondaryCommandBuffer);
+    assert(secondary_command_buffer.GetStatus() == CommandBuffer::Executable);
+    FlushBarriers();
+    vkCmdExecuteCommands(command_buffer.GetHandle(), 1u, &secondary_command_buffer.GetHandle());
+}
+
+void CommandRecorder::ExecuteCommands(const std::vector<CommandBuffer*>& secondary_command_buffers)
+{
+    if (secondary_command_buffers.empty())
+        return;
+
+    std::vector<VkCommandBuffer> handles;
+    handles.reserve(secondary_command_buffers.size());
+    for (const CommandBuffer* secondary_command_buffer : secondary_command_buffers)
+    {
+        assert(secondary_command_buffer->GetLevel() == SecondaryCommandBuffer);
+        assert(secondary_command_buffer->GetStatus() == CommandBuffer::Executable);
+        handles.push_back(secondary_command_buffer->GetHandle());
+    }
+    FlushBarriers();
+    vkCmdExecuteCommands(command_buffer.GetHandle(), static_cast<std::uint32_t>(handles.size()), handles.data());
+}
+
+void CommandRecorder::ImageMemoryBarrier(
+    const VkImage           image,
+    const ImageLayout       old_layout,
+    const PipelineStageMask source_pipe,
+    const ImageLayout       new_layout,
+    const PipelineStageMask destination_pipe,
+    const std::uint32_t     base_mip_level,
+    const std::uint32_t     mip_level_count)
+{
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.baseMipLevel = base_mip_level;
+    subresource_range.levelCount = mip_level_count;
+    subresource_range.layerCount = 1u;
+
+    const VkAccessFlags destination_access = FindSuitableAccessMask(new_layout);
+    barriers.AddImageBarrier(
+        image,
+        subresource_range,
+        static_cast<VkImageLayout>(old_layout),
+        FindSuitableAccessMask(old_layout),
+        source_pipe,
+        static_cast<VkImageLayout>(new_layout),
+        destination_access,
+        destination_pipe);
+
+    ResourceState& state = image_states[image];
+    state.layout = new_layout;
+    state.access = destination_access;
+    state.stages = destination_pipe;
+}
+
+void CommandRecorder::BufferMemoryBarrier(
+    const VkBuffer          buffer,
+    const VkAccessFlags     source_access,
+    const PipelineStageMask source_pipe,
+    const VkAccessFlags     destination_access,
+    const PipelineStageMask destination_pipe)
+{
+    barriers.AddBufferBarrier(
+        buffer, 0u, VK_WHOLE_SIZE,
+        source_access, source_pipe,
+        destination_access, destination_pipe);
+
+    ResourceState& state = buffer_states[buffer];
+    state.access = destination_access;
+    state.stages = destination_pipe;
+}
+
+void CommandRecorder::TrackImage(
+    const VkImage           image,
+    const ImageLayout       current_layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    ResourceState state;
+    state.layout = current_layout;
+    state.access = access;
+    state.stages = stages;
+    image_states.emplace(image, state);
+}
+
+void CommandRecorder::TrackBuffer(
+    const VkBuffer          buffer,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    ResourceState state;
+    state.access = access;
+    state.stages = stages;
+    buffer_states.emplace(buffer, state);
+}
+
+void CommandRecorder::RequireImageState(
+    const VkImage           image,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    auto state = image_states.find(image);
+    if (state == image_states.end())
+    {
+        throw Exception("Image layout is unknown to the command recorder, it has to be tracked first");
+    }
+    RequireState(state->second, image, VK_NULL_HANDLE, layout, access, stages);
+}
+
+void CommandRecorder::RequireImageState(
+    Image&                  image,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    auto state = image_states.find(image.GetImageHandle());
+    if (state == image_states.end())
+    {
+        // Work from earlier submissions may still use the image unless its contents are undefined.
+        ResourceState initial_state;
+        initial_state.layout = image.GetLayout();
+        initial_state.access = FindSuitableAccessMask(image.GetLayout());
+        initial_state.stages = (image.GetLayout() == ImageLayout::Undefined) ? TopOfPipeStage : AllCommandsStage;
+        state = image_states.emplace(image.GetImageHandle(), initial_state).first;
+    }
+    RequireState(state->second, image.GetImageHandle(), VK_NULL_HANDLE, layout, access, stages);
+    image.layout = layout;
+}
+
+void CommandRecorder::RequireBufferState(
+    const VkBuffer          buffer,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    // A buffer seen for the first time starts without access at the top of the pipe, so a first write
+    // still gets its barrier. Writes from earlier submissions (host or transfer uploads) are declared
+    // with TrackBuffer to be waited for.
+    auto state = buffer_states.find(buffer);
+    if (state == buffer_states.end())
+    {
+        state = buffer_states.emplace(buffer, ResourceState()).first;
+    }
+    RequireState(state->second, VK_NULL_HANDLE, buffer, ImageLayout::Undefined, access, stages);
+}
+
+void CommandRecorder::RequireState(
+    ResourceState&          state,
+    const VkImage           image,
+    const VkBuffer          buffer,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    const bool layout_changes = (image != VK_NULL_HANDLE) && (state.layout != layout);
+    const bool has_writes = ((state.access | access) & BarrierBatch::WriteAccessMask) != 0u;
+    if (!layout_changes && !has_writes)
+    {
+        // Reads after reads: remember every reader so that a later write waits for all of them.
+        state.access |= access;
+        state.stages |= stages;
+        return;
+    }
+
+    if (image != VK_NULL_HANDLE)
+    {
+        VkImageSubresourceRange subresource_range = {};
+        subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+        subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        barriers.AddImageBarrier(
+            image,
+            subresource_range,
+            static_cast<VkImageLayout>(state.layout), state.access, state.stages,
+            static_cast<VkImageLayout>(layout), access, stages);
+    }
+    else
+    {
+        barriers.AddBufferBarrier(
+            buffer, 0u, VK_WHOLE_SIZE,
+            state.access, state.stages,
+            access, stages);
+    }
+    state.layout = layout;
+    state.access = access;
+    state.stages = stages;
+}
+
+void CommandRecorder::ReleaseOwnership(const VkBuffer buffer, const QueueType destination_queue)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType source_queue = command_buffer.GetPool().GetQueueType();
+    if (device.SharesQueueFamily(source_queue, destination_queue))
+        return;
+
+    // Writes recorded before this command buffer are unknown here, so make all of them available.
+    auto state = buffer_states.find(buffer);
+    const VkAccessFlags source_access = (state != buffer_states.end()) ? state->second.access : static_cast<VkAccessFlags>(VK_ACCESS_MEMORY_WRITE_BIT);
+    const PipelineStageMask source_stages = (state != buffer_states.end()) ? state->second.stages : static_cast<PipelineStageMask>(AllCommandsStage);
+    barriers.AddBufferOwnershipTransfer(
+        buffer,
+        device.GetQueueFamilyIndex(source_queue),
+        device.GetQueueFamilyIndex(destination_queue),
+        source_access, source_stages,
+        0u, BottomOfPipeStage);
+    if (state != buffer_states.end())
+        buffer_states.erase(state);
+}
+
+void CommandRecorder::AcquireOwnership(
+    const VkBuffer          buffer,
+    const QueueType         source_queue,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType destination_queue = command_buffer.GetPool().GetQueueType();
+    if (device.SharesQueueFamily(source_queue, destination_queue))
+    {
+        RequireBufferState(buffer, access, stages);
+        return;
+    }
+
+    barriers.AddBufferOwnershipTransfer(
+        buffer,
+        device.GetQueueFamilyIndex(source_queue),
+        device.GetQueueFamilyIndex(destination_queue),
+        0u, TopOfPipeStage,
+        access, stages);
+    ResourceState& state = buffer_states[buffer];
+    state.access = access;
+    state.stages = stages;
+}
+
+void CommandRecorder::ReleaseOwnership(Image& image, const QueueType destination_queue)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType source_queue = command_buffer.GetPool().GetQueueType();
+    if (device.SharesQueueFamily(source_queue, destination_queue))
+        return;
+
+    auto state = image_states.find(image.GetImageHandle());
+    const VkAccessFlags source_access = (state != image_states.end()) ? state->second.access : FindSuitableAccessMask(image.GetLayout());
+    const PipelineStageMask source_stages = (state != image_states.end()) ? state->second.stages : static_cast<PipelineStageMask>(AllCommandsStage);
+
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+    subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    barriers.AddImageOwnershipTransfer(
+        image.GetImageHandle(),
+        subresource_range,
+        static_cast<VkImageLayout>(image.GetLayout()),
+        device.GetQueueFamilyIndex(source_queue),
+        device.GetQueueFamilyIndex(destination_queue),
+        source_access, source_stages,
+        0u, BottomOfPipeStage);
+    if (state != image_states.end())
+        image_states.erase(state);
+}
+
+void CommandRecorder::AcquireOwnership(
+    Image&                  image,
+    const QueueType         source_queue,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType destination_queue = command_buffer.GetPool().GetQueueType();
+    if (!device.SharesQueueFamily(source_queue, destination_queue))
+    {
+        // The acquire has to repeat the layout of the release, any transition follows as a separate barrier.
+        const bool layout_changes = image.GetLayout() != layout;
+        VkImageSubresourceRange subresource_range = {};
+        subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+        subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        barriers.AddImageOwnershipTransfer(
+            image.GetImageHandle(),
+            subresource_range,
+            static_cast<VkImageLayout>(image.GetLayout()),
+            device.GetQueueFamilyIndex(source_queue),
+            device.GetQueueFamilyIndex(destination_queue),
+            0u, TopOfPipeStage,
+            layout_changes ? 0u : access, stages);
+
+        ResourceState& state = image_states[image.GetImageHandle()];
+        state.layout = image.GetLayout();
+        state.access = layout_changes ? 0u : access;
+        state.stages = stages;
+        if (!layout_changes)
+            return;
+        FlushBarriers();
+    }
+    RequireImageState(image, layout, access, stages);
+}
+
+void CommandRecorder::ReleaseOwnership(const VkImage image, const QueueType destination_queue)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType source_queue = command_buffer.GetPool().GetQueueType();
+    if (device.SharesQueueFamily(source_queue, destination_queue))
+        return;
+
+    auto state = image_states.find(image);
+    if (state == image_states.end())
+    {
+        throw Exception("Image layout is unknown to the command recorder, it has to be tracked first");
+    }
+
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+    subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    barriers.AddImageOwnershipTransfer(
+        image,
+        subresource_range,
+        static_cast<VkImageLayout>(state->second.layout),
+        device.GetQueueFamilyIndex(source_queue),
+        device.GetQueueFamilyIndex(destination_queue),
+        state->second.access, state->second.stages,
+        0u, BottomOfPipeStage);
+    image_states.erase(state);
+}
+
+void CommandRecorder::AcquireOwnership(
+    const VkImage           image,
+    const QueueType         source_queue,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    const Device& device = command_buffer.GetPool().GetDevice();
+    const QueueType destination_queue = command_buffer.GetPool().GetQueueType();
+    ResourceState& state = image_states[image];
+    state.layout = layout;
+    if (device.SharesQueueFamily(source_queue, destination_queue))
+    {
+        state.access = 0u;
+        state.stages = TopOfPipeStage;
+        return;
+    }
+
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+    subresource_range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    barriers.AddImageOwnershipTransfer(
+        image,
+        subresource_range,
+        static_cast<VkImageLayout>(layout),
+        device.GetQueueFamilyIndex(source_queue),
+        device.GetQueueFamilyIndex(destination_queue),
+        0u, TopOfPipeStage,
+        access, stages);
+    state.access = access;
+    state.stages = stages;
+}
+
+std::vector<VkBufferImageCopy> CommandRecorder::MakeBufferImageCopies(
+    const std::vector<BufferImageRegion>&   regions,
+    const std::size_t                       element_size)
+{
+    std::vector<VkBufferImageCopy> buffer_image_copies;
+    buffer_image_copies.reserve(regions.size());
+    for (const BufferImageRegion& region : regions)
+    {
+        VkBufferImageCopy buffer_image_copy = {};
+        buffer_image_copy.bufferOffset = region.buffer_offset * element_size;
+        buffer_image_copy.bufferRowLength = region.buffer_row_length;
+        buffer_image_copy.bufferImageHeight = region.buffer_image_height;
+        buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        buffer_image_copy.imageSubresource.mipLevel = region.mip_level;
+        buffer_image_copy.imageSubresource.layerCount = 1u;
+        buffer_image_copy.imageOffset = region.image_offset;
+        buffer_image_copy.imageExtent = region.image_extent;
+        buffer_image_copies.push_back(buffer_image_copy);
+    }
+    return buffer_image_copies;
+}
+
+void CommandRecorder::FlushBarriers()
+{
+    barriers.Flush(command_buffer.GetHandle());
+}
+
+const BarrierBatch& CommandRecorder::GetBarriers() const
+{
+    return barriers;
+}
+
+void CommandRecorder::TransitionImageLayout(
+    Image&                  image,
+    const ImageLayout       new_layout,
+    const PipelineStageMask destination_pipe)
+{
+    RequireImageState(image, new_layout, FindSuitableAccessMask(new_layout), destination_pipe);
+}
+
+void CommandRecorder::GenerateMipmaps(
+    Image&                  image,
+    const ImageLayout       final_layout,
+    const PipelineStageMask destination_pipe)
+{
+    assert(image.GetLayout() == ImageLayout::TransferDestination);
+    const std::uint32_t mip_levels = image.GetMipLevelCount();
+
+    // Per level barriers go to the batch directly: the tracked state covers the whole image and is
+    // only valid again once every level is in the same layout.
+    const auto transition_level = [this, &image](const std::uint32_t level)
+    {
+        VkImageSubresourceRange subresource_range = {};
+        subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresource_range.baseMipLevel = level;
+        subresource_range.levelCount = 1u;
+        subresource_range.layerCount = 1u;
+        barriers.AddImageBarrier(
+            image.GetImageHandle(),
+            subresource_range,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+        FlushBarriers();
+    };
+
+    for (std::uint32_t level = 1u; level < mip_levels; ++level)
+    {
+        transition_level(level - 1u);
+
+        const VkExtent3D source_extent = image.GetMipExtent(level - 1u);
+        const VkExtent3D destination_extent = image.GetMipExtent(level);
+
+        VkImageBlit image_blit = {};
+        image_blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.srcSubresource.mipLevel = level - 1u;
+        image_blit.srcSubresource.layerCount = 1u;
+        image_blit.srcOffsets[1].x = static_cast<std::int32_t>(source_extent.width);
+        image_blit.srcOffsets[1].y = static_cast<std::int32_t>(source_extent.height);
+        image_blit.srcOffsets[1].z = static_cast<std::int32_t>(source_extent.depth);
+        image_blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_blit.dstSubresource.mipLevel = level;
+        image_blit.dstSubresource.layerCount = 1u;
+        image_blit.dstOffsets[1].x = static_cast<std::int32_t>(destination_extent.width);
+        image_blit.dstOffsets[1].y = static_cast<std::int32_t>(destination_extent.height);
+        image_blit.dstOffsets[1].z = static_cast<std::int32_t>(destination_extent.depth);
+
+        vkCmdBlitImage(
+            command_buffer.GetHandle(),
+            image.GetImageHandle(),
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image.GetImageHandle(),
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1u,
+            &image_blit,
+            VK_FILTER_LINEAR);
+    }
+
+    // Bring the last level in line with the others, so that the whole image is a transfer source
+    // and the move to the final layout is an ordinary tracked transition that later ones can merge with.
+    if (mip_levels > 1u)
+    {
+        transition_level(mip_levels - 1u);
+
+        ResourceState& state = image_states[image.GetImageHandle()];
+        state.layout = ImageLayout::TransferSource;
+        state.access = VK_ACCESS_TRANSFER_WRITE_BIT;
+        state.stages = TransferStage;
+        image.layout = ImageLayout::TransferSource;
+    }
+    RequireImageState(image, final_layout, FindSuitableAccessMask(final_layout), destination_pipe);
+}
+
+void CommandRecorder::CopyImage(
+    const VkImage           source,
+    const ImageLayout       source_layout,
+    const VkImage           destination,
+    const ImageLayout       destination_layout,
+    const VkExtent3D&       extent)
+{
+    TrackImage(source, source_layout);
+    TrackImage(destination, destination_layout);
+    RequireImageState(source, ImageLayout::TransferSource, VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+    RequireImageState(destination, ImageLayout::TransferDestination, VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+
+    VkImageCopy image_copy = {};
+    image_copy.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy.srcSubresource.layerCount = 1u;
+    image_copy.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    image_copy.dstSubresource.layerCount = 1u;
+    image_copy.extent = extent;
+
+    vkCmdCopyImage(
+        command_buffer.GetHandle(),
+        source,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        destination,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        1u,
+        &image_copy);
+
+    RequireImageState(source, source_layout, 0u, BottomOfPipeStage);
+    RequireImageState(destination, destination_layout, 0u, BottomOfPipeStage);
+}
+
+void CommandRecorder::ClearColorImage(const VkImage image, const VkClearColorValue& color)
+{
+    RequireImageState(image, ImageLayout::TransferDestination, VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+
+    VkImageSubresourceRange subresource_range = {};
+    subresource_range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresource_range.levelCount = 1u;
+    subresource_range.layerCount = 1u;
+    vkCmdClearColorImage(
+        command_buffer.GetHandle(),
+        image,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        &color,
+        1u,
+        &subresource_range);
+}
+
+void CommandRecorder::BindPipeline(const ComputePipeline& pipeline)
 {
+    vkCmdBindPipeline(command_buffer.GetHandle(), VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.GetHandle());
+}
+
+void CommandRecorder::BindDescriptorSets(
+    const PipelineLayout&               layout,
+    const std::uint32_t                 first_set,
+    const std::vector<VkDescriptorSet>& sets,
+    const std::vector<std::uint32_t>&   dynamic_offsets)
+{
+    vkCmdBindDescriptorSets(
+        command_buffer.GetHandle(),
+        VK_PIPELINE_BIND_POINT_COMPUTE,
+        layout.GetHandle(),
+        first_set,
+        static_cast<std::uint32_t>(sets.size()),
+        sets.data(),
+        static_cast<std::uint32_t>(dynamic_offsets.size()),
+        dynamic_offsets.empty() ? nullptr : dynamic_offsets.data());
+}
+
+void CommandRecorder::PushConstants(
+    const PipelineLayout&   layout,
+    const std::uint32_t     offset,
+    const std::uint32_t     size,
+    const void*             data)
+{
+    assert(offset % 4u == 0u && size % 4u == 0u && offset + size <= layout.GetPushConstantSize());
+    vkCmdPushConstants(command_buffer.GetHandle(), layout.GetHandle(), VK_SHADER_STAGE_COMPUTE_BIT, offset, size, data);
+}
+
+void CommandRecorder::Dispatch(const std::uint32_t group_count_x, const std::uint32_t group_count_y, const std::uint32_t group_count_z)
+{
+    FlushBarriers();
+    vkCmdDispatch(command_buffer.GetHandle(), group_count_x, group_count_y, group_count_z);
+}
+
+
+SubmitBatch::SubmitBatch() :
+    SubmitBatch(VK_NULL_HANDLE)
+{
+}
+
+SubmitBatch::SubmitBatch(const VkQueue queue) :
+    queue(queue),
+    submit_ranges(1u)
+{
+}
+
+SubmitBatch& SubmitBatch::Add(const CommandBuffer& command_buffer)
+{
+    assert(command_buffer.GetLevel() == PrimaryCommandBuffer);
     if (command_buffer.GetStatus() != CommandBuffer::Executable)
     {
         throw Exception("Failed to submit command buffers for execution: they are not in an executable state");
     }
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.pNext = nullptr;
-    submit_info.commandBufferCount = 1u;
-    submit_info.pCommandBuffers = &(command_buffer.GetHandle());
-    submit_info.pSignalSemaphores = (signal_semaphore_ptr == nullptr) ? nullptr : &signal_semaphore_ptr->GetHandle();
-    submit_info.signalSemaphoreCount = (signal_semaphore_ptr == nullptr) ? 0u : 1u;
-    VkQueue queue = command_buffer.GetPool().GetQueue();
-    if (vkQueueSubmit(queue, 1u, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS)
+    const VkQueue command_buffer_queue = command_buffer.GetPool().GetQueue();
+    if (queue == VK_NULL_HANDLE)
+    {
+        queue = command_buffer_queue;
+    }
+    assert(queue == command_buffer_queue);
+    command_buffers.push_back(command_buffer.GetHandle());
+    return *this;
+}
+
+SubmitBatch& SubmitBatch::Wait(const Semaphore& semaphore, const PipelineStageMask wait_stage_mask)
+{
+    wait_semaphores.push_back(semaphore.GetHandle());
+    wait_stage_masks.push_back(wait_stage_mask);
+    wait_values.push_back(0u);
+    return *this;
+}
+
+SubmitBatch& SubmitBatch::Signal(const Semaphore& semaphore)
+{
+    signal_semaphores.push_back(semaphore.GetHandle());
+    signal_values.push_back(0u);
+    return *this;
+}
+
+SubmitBatch& SubmitBatch::Wait(
+    const TimelineSemaphore&    semaphore,
+    const std::uint64_t         value,
+    const PipelineStageMask     wait_stage_mask)
+{
+    wait_semaphores.push_back(semaphore.GetHandle());
+    wait_stage_masks.push_back(wait_stage_mask);
+    wait_values.push_back(value);
+    has_timeline_semaphores = true;
+    return *this;
+}
+
+SubmitBatch& SubmitBatch::Signal(const TimelineSemaphore& semaphore, const std::uint64_t value)
+{
+    signal_semaphores.push_back(semaphore.GetHandle());
+    signal_values.push_back(value);
+    has_timeline_semaphores = true;
+    return *this;
+}
+
+SubmitBatch& SubmitBatch::NextSubmit()
+{
+    SubmitRange range;
+    range.first_wait_semaphore = static_cast<std::uint32_t>(wait_semaphores.size());
+    range.first_command_buffer = static_cast<std::uint32_t>(command_buffers.size());
+    range.first_signal_semaphore = static_cast<std::uint32_t>(signal_semaphores.size());
+    submit_ranges.push_back(range);
+    return *this;
+}
+
+bool SubmitBatch::IsEmpty() const
+{
+    return command_buffers.empty() && wait_semaphores.empty() && signal_semaphores.empty();
+}
+
+VkQueue SubmitBatch::GetQueue() const
+{
+    return queue;
+}
+
+void SubmitBatch::Submit(const Fence* fence_ptr)
+{
+    if (queue == VK_NULL_HANDLE)
+    {
+        throw Exception("Failed to submit command buffers for execution: no queue to submit to");
+    }
+
+    std::vector<VkSubmitInfo> submit_infos;
+    submit_infos.reserve(submit_ranges.size());
+    // Reserved up front: the submit infos point into it.
+    std::vector<VkTimelineSemaphoreSubmitInfoKHR> timeline_infos;
+    timeline_infos.reserve(has_timeline_semaphores ? submit_ranges.size() : 0u);
+    for (std::size_t i = 0u; i != submit_ranges.size(); ++i)
     {
-        throw Exception("Failed to submit command buffers for execution");
+        const SubmitRange& range = submit_ranges[i];
+        const bool is_last = (i + 1u == submit_ranges.size());
+        const std::uint32_t end_wait_semaphore = is_last ?
+            static_cast<std::uint32_t>(wait_semaphores.size()) : submit_ranges[i + 1u].first_wait_semaphore;
+        const std::uint32_t end_command_buffer = is_last ?
+            static_cast<std::uint32_t>(command_buffers.size()) : submit_ranges[i + 1u].first_command_buffer;
+        const std::uint32_t end_signal_semaphore = is_last ?
+            static_cast<std::uint32_t>(signal_semaphores.size()) : submit_ranges[i + 1u].first_signal_semaphore;
+
+        VkSubmitInfo submit_info = {};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.waitSemaphoreCount = end_wait_semaphore - range.first_wait_semaphore;
+        submit_info.pWaitSemaphores = wait_semaphores.data() + range.first_wait_semaphore;
+        submit_info.pWaitDstStageMask = wait_stage_masks.data() + range.first_wait_semaphore;
+        submit_info.commandBufferCount = end_command_buffer - range.first_command_buffer;
+        submit_info.pCommandBuffers = command_buffers.data() + range.first_command_buffer;
+        submit_info.signalSemaphoreCount = end_signal_semaphore - range.first_signal_semaphore;
+        submit_info.pSignalSemaphores = signal_semaphores.data() + range.first_signal_semaphore;
+        if (has_timeline_semaphores)
+        {
+            VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+            timeline_info.waitSemaphoreValueCount = submit_info.waitSemaphoreCount;
+            timeline_info.pWaitSemaphoreValues = wait_values.data() + range.first_wait_semaphore;
+            timeline_info.signalSemaphoreValueCount = submit_info.signalSemaphoreCount;
+            timeline_info.pSignalSemaphoreValues = signal_values.data() + range.first_signal_semaphore;
+            timeline_infos.push_back(timeline_info);
+            submit_info.pNext = &timeline_infos.back();
+        }
+
+        // Empty submits are only worth keeping if they carry the fence.
+        if (submit_info.waitSemaphoreCount != 0u ||
+            submit_info.commandBufferCount != 0u ||
+            submit_info.signalSemaphoreCount != 0u)
+        {
+            submit_infos.push_back(submit_info);
+        }
+    }
+
+    const VkFence fence = (fence_ptr == nullptr) ? VK_NULL_HANDLE : fence_ptr->GetHandle();
+    if (!submit_infos.empty() || fence != VK_NULL_HANDLE)
+    {
+        if (vkQueueSubmit(queue, static_cast<std::uint32_t>(submit_infos.size()), submit_infos.data(), fence) != VK_SUCCESS)
+        {
+            throw Exception("Failed to submit command buffers for execution");
+        }
     }
+    Clear();
+}
+
+void SubmitBatch::Clear()
+{
+    wait_semaphores.clear();
+    wait_stage_masks.clear();
+    command_buffers.clear();
+    signal_semaphores.clear();
+    submit_ranges.assign(1u, SubmitRange());
+    wait_values.clear();
+    signal_values.clear();
+    has_timeline_semaphores = false;
 }
 
 
 void SubmitCommands(
     const CommandBuffer&    command_buffer,
-    const Semaphore*        signal_semaphore_ptr)
+    const Semaphore*        signal_semaphore_ptr,
+    const Fence*            fence_ptr)
 {
-    VkSubmitInfo submit_info = {};
-    DoSubmitCommands(submit_info, command_buffer, signal_semaphore_ptr);
+    SubmitBatch batch;
+    batch.Add(command_buffer);
+    if (signal_semaphore_ptr != nullptr)
+    {
+        batch.Signal(*signal_semaphore_ptr);
+    }
+    batch.Submit(fence_ptr);
 }
 
 
@@ -192,13 +1075,16 @@ void SubmitCommands(
     const CommandBuffer&    command_buffer,
     const PipelineStageMask wait_stage_mask,
     const Semaphore&        wait_semaphore,
-    const Semaphore*        signal_semaphore_ptr)
+    const Semaphore*        signal_semaphore_ptr,
+    const Fence*            fence_ptr)
 {
-    VkSubmitInfo submit_info = {};
-    submit_info.pWaitDstStageMask = &wait_stage_mask;
-    submit_info.pWaitSemaphores = &wait_semaphore.GetHandle();
-    submit_info.waitSemaphoreCount = 1u;
-    DoSubmitCommands(submit_info, command_buffer, signal_semaphore_ptr);
+    SubmitBatch batch;
+    batch.Add(command_buffer).Wait(wait_semaphore, wait_stage_mask);
+    if (signal_semaphore_ptr != nullptr)
+    {
+        batch.Signal(*signal_semaphore_ptr);
+    }
+    batch.Submit(fence_ptr);
 }
 
 }
@@ -2,8 +2,13 @@
 
 
 #include <array>
+#include <deque>
+#include <map>
+#include <vector>
 
+#include <vulkan/barrier_batch.h>
 #include <vulkan/device.h>
+#include <vulkan/image.h>
 #include <vulkan/memory.h>
 #include <vulkan/object.h>
 
@@ -34,42 +39,68 @@ namespace ct
         };
         using PipelineStageMask = std::uint32_t;
 
-        enum class ImageLayout : std::uint32_t
+        enum CommandPoolFlag : std::uint32_t
         {
-            Undefined = VK_IMAGE_LAYOUT_UNDEFINED,
-            TransferSource = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-            TransferDestination = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            PresentSource = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            ResettableCommandBuffers = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+            TransientCommandBuffers = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
         };
+        using CommandPoolFlags = std::uint32_t;
+
+        enum CommandBufferLevel : std::uint32_t
+        {
+            PrimaryCommandBuffer = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            SecondaryCommandBuffer = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        };
+
+        class CommandBuffer;
+        class ComputePipeline;
+        class Fence;
+        class PipelineLayout;
 
         class CommandPool : public Object<VkCommandPool>
         {
         public:
-            explicit CommandPool(const Device& device, QueueType queue_type);
+            explicit CommandPool(const Device& device, QueueType queue_type, const CommandPoolFlags flags = 0u);
+            CommandPool(CommandPool&& other);
             ~CommandPool();
 
             const Device& GetDevice() const;
             QueueType GetQueueType() const;
+            CommandPoolFlags GetFlags() const;
             VkQueue GetQueue() const;
             void WaitForQueue() const;
             void Trim() const;
 
+            // Allocates several command buffers with a single driver call.
+            std::vector<CommandBuffer> AllocateCommandBuffers(
+                const std::uint32_t         count,
+                const CommandBufferLevel    level = PrimaryCommandBuffer) const;
+
+            // Returns every command buffer of the pool to the initial state at once.
+            // None of them may be pending execution.
+            void Reset(const bool release_resources = false);
+            std::uint64_t GetResetCount() const;
+
         private:
-            const Device& device;
-            const QueueType queue_type;
+            const Device&           device;
+            const QueueType         queue_type;
+            const CommandPoolFlags  flags;
+            std::uint64_t           reset_count;
         };
 
 
         class CommandBuffer : public Object<VkCommandBuffer>
         {
             friend class CommandRecorder;
+            friend class CommandPool;
 
         public:
-            CommandBuffer(const CommandPool& command_pool);
+            CommandBuffer(const CommandPool& command_pool, const CommandBufferLevel level = PrimaryCommandBuffer);
             ~CommandBuffer();
             CommandBuffer(CommandBuffer&& other);
 
             const CommandPool& GetPool() const;
+            CommandBufferLevel GetLevel() const;
 
             enum Status
             {
@@ -82,11 +113,89 @@ namespace ct
             void Reset();
 
         private:
-            void StartRecording();
+            CommandBuffer(const CommandPool& command_pool, const CommandBufferLevel level, const VkCommandBuffer handle);
+
+            void StartRecording(const VkCommandBufferInheritanceInfo* inheritance_info);
             void StopRecording();
 
-            const CommandPool& command_pool;
-            Status status;
+            const CommandPool&          command_pool;
+            const CommandBufferLevel    level;
+            Status                      status;
+            std::uint64_t               pool_reset_count; // Status is stale once the whole pool has been reset
+        };
+
+
+        // One transient command pool per frame in flight. A frame's pool is reset wholesale once the
+        // fence of the frame that last used it has signaled, and its command buffers are handed out again
+        // instead of being freed and reallocated every frame.
+        class FrameCommandPools
+        {
+        public:
+            explicit FrameCommandPools(
+                const Device&       device,
+                const QueueType     queue_type,
+                const std::uint32_t frames_in_flight);
+            FrameCommandPools(const FrameCommandPools& other) = delete;
+
+            void BeginFrame();
+            void EndFrame(const Fence& fence);
+
+            // A command buffer in the initial state that stays valid until the frame's pool is reused.
+            CommandBuffer& AcquireCommandBuffer(const CommandBufferLevel level = PrimaryCommandBuffer);
+
+            const CommandPool& GetCurrentPool() const;
+
+        private:
+            struct Frame
+            {
+                explicit Frame(CommandPool&& pool) : pool(std::move(pool)) {}
+
+                CommandPool                 pool;
+                // Indexed by CommandBufferLevel. A deque keeps handed out references valid while it grows.
+                std::deque<CommandBuffer>   command_buffers[2];
+                std::size_t                 used_counts[2] = {};
+                const Fence*                fence = nullptr;
+            };
+
+            std::vector<Frame>  frames;
+            std::uint32_t       frame_index;
+        };
+
+
+        // Ranges of typed buffers. Offsets and counts are in elements, not bytes.
+        struct BufferRange
+        {
+            std::size_t offset = 0u;
+            std::size_t count = 0u;
+        };
+
+        struct BufferCopyRegion
+        {
+            std::size_t source_offset = 0u;
+            std::size_t destination_offset = 0u;
+            std::size_t count = 0u;
+        };
+
+        // A box of an image and where its texels are in a buffer. Zero row length and image height
+        // mean the texels of the box are tightly packed; otherwise they are given in texels.
+        struct BufferImageRegion
+        {
+            std::size_t     buffer_offset = 0u;
+            std::uint32_t   buffer_row_length = 0u;
+            std::uint32_t   buffer_image_height = 0u;
+            VkOffset3D      image_offset = {};
+            VkExtent3D      image_extent = {};
+            std::uint32_t   mip_level = 0u;
+        };
+
+
+        // State a secondary command buffer inherits from the primary that executes it.
+        // Outside of a render pass all handles stay null.
+        struct CommandBufferInheritance
+        {
+            VkRenderPass    render_pass = VK_NULL_HANDLE;
+            std::uint32_t   subpass = 0u;
+            VkFramebuffer   framebuffer = VK_NULL_HANDLE;
         };
 
 
@@ -94,17 +203,45 @@ namespace ct
         {
         public:
             CommandRecorder(CommandBuffer& command_buffer);
+            CommandRecorder(CommandBuffer& command_buffer, const CommandBufferInheritance& inheritance);
             ~CommandRecorder();
             CommandRecorder(CommandRecorder&& other) = delete;
 
-            template <typename Buffer>
-            void Fill(Buffer& buffer, const uint32_t data);
+            template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+            void Fill(Buffer<T, MemoryType, UsageFlags>& buffer, const uint32_t data);
+
+            // Byte offsets and sizes of the ranges must be multiples of 4.
+            template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+            void Fill(Buffer<T, MemoryType, UsageFlags>& buffer, const uint32_t data, const std::vector<BufferRange>& ranges);
+
+            // Stitches secondary command buffers recorded elsewhere (possibly on other threads) into this one.
+            void ExecuteCommands(const CommandBuffer& secondary_command_buffer);
+            void ExecuteCommands(const std::vector<CommandBuffer*>& secondary_command_buffers);
 
             template <typename T,
                 typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags,
                 typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
             void Transfer(const Buffer<T, SrcMemoryType, SrcUsageFlags>& from, Buffer<T, DstMemoryType, DstUsageFlags>& to);
 
+            // Copies only the given regions, all of them with a single vkCmdCopyBuffer.
+            template <typename T,
+                typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags,
+                typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+            void Copy(
+                const Buffer<T, SrcMemoryType, SrcUsageFlags>&  from,
+                Buffer<T, DstMemoryType, DstUsageFlags>&        to,
+                const std::vector<BufferCopyRegion>&            regions);
+
+            template <typename T,
+                typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags,
+                typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+            void Copy(
+                const Buffer<T, SrcMemoryType, SrcUsageFlags>&  from,
+                Buffer<T, DstMemoryType, DstUsageFlags>&        to,
+                const std::size_t                               source_offset,
+                const std::size_t                               destination_offset,
+                const std::size_t                               count);
+
             VkAccessFlags FindSuitableAccessMask(const ImageLayout layout)
             {
                 switch (layout)
@@ -113,80 +250,339 @@ namespace ct
                     return VK_ACCESS_TRANSFER_WRITE_BIT;
                 case ImageLayout::TransferSource:
                     return VK_ACCESS_TRANSFER_READ_BIT;
+                case ImageLayout::General:
+                    return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                case ImageLayout::ColorAttachment:
+                    return VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+                case ImageLayout::ShaderReadOnly:
+                    return VK_ACCESS_SHADER_READ_BIT;
+                case ImageLayout::Preinitialized:
+                    return VK_ACCESS_HOST_WRITE_BIT;
                 default:
                     return 0u;
                 }
             }
 
+            // Low level barriers, queued until the next recorded command. They also update the tracked state.
             void ImageMemoryBarrier(
                 const VkImage           image,
                 const ImageLayout       old_layout,
                 const PipelineStageMask source_pipe,
                 const ImageLayout       new_layout,
-                const PipelineStageMask destination_pipe)
-            {
-                VkImageMemoryBarrier image_memory_barrier = {};
-                image_memory_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-
-                image_memory_barrier.srcAccessMask = FindSuitableAccessMask(old_layout);
-                image_memory_barrier.dstAccessMask = FindSuitableAccessMask(new_layout);
-                image_memory_barrier.oldLayout = static_cast<VkImageLayout>(old_layout);
-                image_memory_barrier.newLayout = static_cast<VkImageLayout>(new_layout);
-                image_memory_barrier.image = image;
-                image_memory_barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                image_memory_barrier.subresourceRange.levelCount = 1;
-                image_memory_barrier.subresourceRange.layerCount = 1;
-                image_memory_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-                image_memory_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-
-                vkCmdPipelineBarrier(
-                    command_buffer.GetHandle(),
-                    source_pipe,
-                    destination_pipe,
-                    0,
-                    0,
-                    nullptr,
-                    0,
-                    nullptr,
-                    1,
-                    &image_memory_barrier);
-            }
+                const PipelineStageMask destination_pipe,
+                const std::uint32_t     base_mip_level = 0u,
+                const std::uint32_t     mip_level_count = 1u);
 
+            void BufferMemoryBarrier(
+                const VkBuffer          buffer,
+                const VkAccessFlags     source_access,
+                const PipelineStageMask source_pipe,
+                const VkAccessFlags     destination_access,
+                const PipelineStageMask destination_pipe);
+
+            // State tracking: declare how a resource is about to be used and the recorder queues
+            // the barrier (if any) needed since its previous use in this command buffer.
+            // Images owned elsewhere (e.g. swapchain images) have to be introduced with TrackImage first.
+            // The access and stages of the previous use, if it was recorded earlier on the same queue.
+            void TrackImage(
+                const VkImage           image,
+                const ImageLayout       current_layout,
+                const VkAccessFlags     access = 0u,
+                const PipelineStageMask stages = TopOfPipeStage);
+            void TrackBuffer(
+                const VkBuffer          buffer,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+            void RequireImageState(
+                const VkImage           image,
+                const ImageLayout       layout,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+            void RequireImageState(
+                Image&                  image,
+                const ImageLayout       layout,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+            void RequireBufferState(
+                const VkBuffer          buffer,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+
+            // Queue family ownership transfers of exclusive resources, e.g. bricks uploaded on the transfer
+            // queue and sampled on the graphics one. The release is recorded on the queue giving the resource
+            // up and the acquire on the receiving queue, whose submission has to wait on a semaphore signaled
+            // by the releasing one. Both are plain state requirements when the queues share a family.
+            // Layout transitions happen on the acquiring side.
+            void ReleaseOwnership(const VkBuffer buffer, const QueueType destination_queue);
+            void AcquireOwnership(
+                const VkBuffer          buffer,
+                const QueueType         source_queue,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+            void ReleaseOwnership(Image& image, const QueueType destination_queue);
+            void AcquireOwnership(
+                Image&                  image,
+                const QueueType         source_queue,
+                const ImageLayout       layout,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+
+            // Images owned elsewhere change queue families in their tracked layout: the release needs the
+            // image to be tracked, and the acquire starts tracking it in the layout it was released in.
+            void ReleaseOwnership(const VkImage image, const QueueType destination_queue);
+            void AcquireOwnership(
+                const VkImage           image,
+                const QueueType         source_queue,
+                const ImageLayout       layout,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+
+            // Records all queued barriers. Every command that touches resources calls it first.
+            void FlushBarriers();
+            const BarrierBatch& GetBarriers() const;
+
+            // Moves all mip levels of the image from its tracked layout to a new one.
+            void TransitionImageLayout(
+                Image&                  image,
+                const ImageLayout       new_layout,
+                const PipelineStageMask destination_pipe);
+
+            // Fills mip level 0 from a tightly packed buffer; the image is left as a transfer destination.
+            template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+            void CopyBufferToImage(const Buffer<T, SrcMemoryType, SrcUsageFlags>& buffer, Image& image);
+
+            // Updates only the given boxes of the image, e.g. the bricks of a volume that changed.
+            template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+            void CopyBufferToImage(
+                const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+                Image&                                          image,
+                const std::vector<BufferImageRegion>&           regions);
+
+            // Downsamples each mip level from the previous one with linear blits, then moves the
+            // whole image to final_layout. Expects level 0 to hold the data as a transfer destination.
+            void GenerateMipmaps(
+                Image&                  image,
+                const ImageLayout       final_layout,
+                const PipelineStageMask destination_pipe);
+
+            // CopyBufferToImage followed by GenerateMipmaps.
+            template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+            void Upload(
+                const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+                Image&                                          image,
+                const ImageLayout                               final_layout,
+                const PipelineStageMask                         destination_pipe);
+
+            // The image enters and leaves the command buffer in the given layout, which is PresentSource
+            // for swapchain images and anything else for offscreen targets.
             template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
             void Blit(
                 const Buffer<T, SrcMemoryType, SrcUsageFlags>& buffer,
                 const VkImage                                   image,
                 const uint32_t                                  width,
-                const uint32_t                                  height);
+                const uint32_t                                  height,
+                const ImageLayout                               layout = ImageLayout::PresentSource);
+
+            // Copies only the given rectangles (e.g. dirty tiles) into a presentable image.
+            template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+            void Blit(
+                const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+                const VkImage                                   image,
+                const std::vector<BufferImageRegion>&           regions,
+                const ImageLayout                               layout = ImageLayout::PresentSource);
+
+            // Copies a presentable image into a buffer and makes the result visible to the host.
+            template <typename T, typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+            void CopyImageToBuffer(
+                const VkImage                                   image,
+                const uint32_t                                  width,
+                const uint32_t                                  height,
+                Buffer<T, DstMemoryType, DstUsageFlags>&        buffer,
+                const ImageLayout                               layout = ImageLayout::PresentSource);
+
+            // Copies the top-left corner of one image into another of the same format on the device.
+            // Each image enters and leaves the command buffer in its given layout.
+            void CopyImage(
+                const VkImage           source,
+                const ImageLayout       source_layout,
+                const VkImage           destination,
+                const ImageLayout       destination_layout,
+                const VkExtent3D&       extent);
+
+            // Fills every texel of the first mip level with the color. The image has to be tracked and is
+            // left as a transfer destination.
+            void ClearColorImage(const VkImage image, const VkClearColorValue& color);
+
+            // Compute work. Dispatches flush the queued barriers, but the uses of the resources the shader
+            // touches have to be required beforehand (which a FrameGraph pass does from its declared uses).
+            void BindPipeline(const ComputePipeline& pipeline);
+            void BindDescriptorSets(
+                const PipelineLayout&               layout,
+                const std::uint32_t                 first_set,
+                const std::vector<VkDescriptorSet>& sets,
+                const std::vector<std::uint32_t>&   dynamic_offsets = {});
+            void PushConstants(
+                const PipelineLayout&   layout,
+                const std::uint32_t     offset,
+                const std::uint32_t     size,
+                const void*             data);
+            template <typename T>
+            void PushConstants(const PipelineLayout& layout, const T& data, const std::uint32_t offset = 0u);
+            void Dispatch(const std::uint32_t group_count_x, const std::uint32_t group_count_y = 1u, const std::uint32_t group_count_z = 1u);
+
+            // The group counts are read from a VkDispatchIndirectCommand at the given byte offset, which a
+            // previous pass may have written on the device.
+            template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+            void DispatchIndirect(const Buffer<T, MemoryType, UsageFlags>& buffer, const VkDeviceSize offset = 0u);
 
 
         private:
-            CommandBuffer& command_buffer;
+            struct ResourceState
+            {
+                ImageLayout         layout = ImageLayout::Undefined;
+                VkAccessFlags       access = 0u;
+                PipelineStageMask   stages = TopOfPipeStage;
+            };
+
+            static std::vector<VkBufferImageCopy> MakeBufferImageCopies(
+                const std::vector<BufferImageRegion>&   regions,
+                const std::size_t                       element_size);
+
+            void RequireState(
+                ResourceState&          state,
+                const VkImage           image,
+                const VkBuffer          buffer,
+                const ImageLayout       layout,
+                const VkAccessFlags     access,
+                const PipelineStageMask stages);
+
+            CommandBuffer&                      command_buffer;
+            BarrierBatch                        barriers;
+            std::map<VkImage, ResourceState>    image_states;
+            std::map<VkBuffer, ResourceState>   buffer_states;
         };
 
 
         class Semaphore;
+        class TimelineSemaphore;
+
+
+        // Accumulates command buffers and semaphores and hands them to the queue in a single
+        // vkQueueSubmit. NextSubmit() starts a new VkSubmitInfo inside the same call, so work with
+        // different wait/signal semaphores can still share one submission. Binary and timeline
+        // semaphores can be mixed freely.
+        class SubmitBatch
+        {
+        public:
+            // The queue is taken from the pool of the first added command buffer.
+            SubmitBatch();
+            explicit SubmitBatch(const VkQueue queue);
+
+            SubmitBatch& Add(const CommandBuffer& command_buffer);
+            SubmitBatch& Wait(const Semaphore& semaphore, const PipelineStageMask wait_stage_mask);
+            SubmitBatch& Signal(const Semaphore& semaphore);
+            SubmitBatch& Wait(
+                const TimelineSemaphore&    semaphore,
+                const std::uint64_t         value,
+                const PipelineStageMask     wait_stage_mask);
+            SubmitBatch& Signal(const TimelineSemaphore& semaphore, const std::uint64_t value);
+            SubmitBatch& NextSubmit();
+
+            bool IsEmpty() const;
+            // VK_NULL_HANDLE until the queue is known.
+            VkQueue GetQueue() const;
+
+            // Submits everything recorded so far and clears the batch for reuse.
+            void Submit(const Fence* fence_ptr = nullptr);
+            void Clear();
+
+        private:
+            struct SubmitRange
+            {
+                std::uint32_t first_wait_semaphore = 0u;
+                std::uint32_t first_command_buffer = 0u;
+                std::uint32_t first_signal_semaphore = 0u;
+            };
+
+            VkQueue                             queue;
+            std::vector<VkSemaphore>            wait_semaphores;
+            std::vector<VkPipelineStageFlags>   wait_stage_masks;
+            std::vector<VkCommandBuffer>        command_buffers;
+            std::vector<VkSemaphore>            signal_semaphores;
+            std::vector<SubmitRange>            submit_ranges;
+
+            // Parallel to the semaphore arrays; the values of binary semaphores are ignored.
+            std::vector<std::uint64_t>          wait_values;
+            std::vector<std::uint64_t>          signal_values;
+            bool                                has_timeline_semaphores = false;
+        };
 
 
         void SubmitCommands(
             const CommandBuffer&    command_buffer,
-            const Semaphore*        signal_semaphore_ptr = nullptr);
+            const Semaphore*        signal_semaphore_ptr = nullptr,
+            const Fence*            fence_ptr = nullptr);
 
 
         void SubmitCommands(
             const CommandBuffer&    command_buffer,
             const PipelineStageMask wait_stage_mask,
             const Semaphore&        wait_semaphore,
-            const Semaphore*        signal_semaphore_ptr = nullptr);
+            const Semaphore*        signal_semaphore_ptr = nullptr,
+            const Fence*            fence_ptr = nullptr);
     }
 }
 
 
 
-template <typename Buffer>
-void ct::vulkan::CommandRecorder::Fill(Buffer& buffer, const uint32_t data)
+template <typename T>
+void ct::vulkan::CommandRecorder::PushConstants(const PipelineLayout& layout, const T& data, const std::uint32_t offset)
 {
-    vkCmdFillBuffer(command_buffer.GetHandle(), buffer.GetHandle(), 0, buffer.GetSizeInBytes(), data);
+    PushConstants(layout, offset, static_cast<std::uint32_t>(sizeof(T)), &data);
+}
+
+template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+void ct::vulkan::CommandRecorder::DispatchIndirect(const Buffer<T, MemoryType, UsageFlags>& buffer, const VkDeviceSize offset)
+{
+    static_assert((UsageFlags & VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT) != 0,
+        "Indirect buffer must have VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT flag set");
+    assert(offset % 4u == 0u && offset + sizeof(VkDispatchIndirectCommand) <= buffer.GetSizeInBytes());
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_INDIRECT_COMMAND_READ_BIT, DrawIndirectStage);
+    FlushBarriers();
+    vkCmdDispatchIndirect(command_buffer.GetHandle(), buffer.GetBufferHandle(), offset);
+}
+
+template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+void ct::vulkan::CommandRecorder::Fill(Buffer<T, MemoryType, UsageFlags>& buffer, const uint32_t data)
+{
+    static_assert((UsageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) != 0,
+        "Destination buffer must have VK_BUFFER_USAGE_TRANSFER_DST_BIT flag set");
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+    vkCmdFillBuffer(command_buffer.GetHandle(), buffer.GetBufferHandle(), 0, buffer.GetSizeInBytes(), data);
+}
+
+template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+void ct::vulkan::CommandRecorder::Fill(
+    Buffer<T, MemoryType, UsageFlags>&  buffer,
+    const uint32_t                      data,
+    const std::vector<BufferRange>&     ranges)
+{
+    static_assert((UsageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) != 0,
+        "Destination buffer must have VK_BUFFER_USAGE_TRANSFER_DST_BIT flag set");
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+    for (const BufferRange& range : ranges)
+    {
+        assert(range.offset + range.count <= buffer.GetCount());
+        assert((range.offset * sizeof(T)) % 4u == 0u && (range.count * sizeof(T)) % 4u == 0u);
+        vkCmdFillBuffer(
+            command_buffer.GetHandle(),
+            buffer.GetBufferHandle(),
+            range.offset * sizeof(T),
+            range.count * sizeof(T),
+            data);
+    }
 }
 
 template <typename T,
@@ -195,17 +591,110 @@ template <typename T,
 void ct::vulkan::CommandRecorder::Transfer(
     const Buffer<T, SrcMemoryType, SrcUsageFlags>&  from,
     Buffer<T, DstMemoryType, DstUsageFlags>&        to)
+{
+    assert(from.GetCount() == to.GetCount());
+    Copy(from, to, 0u, 0u, from.GetCount());
+}
+
+template <typename T,
+    typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags,
+    typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+void ct::vulkan::CommandRecorder::Copy(
+    const Buffer<T, SrcMemoryType, SrcUsageFlags>&  from,
+    Buffer<T, DstMemoryType, DstUsageFlags>&        to,
+    const std::vector<BufferCopyRegion>&            regions)
 {
     static_assert((SrcUsageFlags & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) != 0,
         "Source buffer must have VK_BUFFER_USAGE_TRANSFER_SRC_BIT flag set");
     static_assert((DstUsageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) != 0,
         "Destination buffer must have VK_BUFFER_USAGE_TRANSFER_DST_BIT flag set");
-    VkBufferCopy copy_region;
-    copy_region.srcOffset = 0u;
-    copy_region.dstOffset = 0u;
-    copy_region.size = from.GetSizeInBytes();
-    assert(copy_region.size == to.GetSizeInBytes());
-    vkCmdCopyBuffer(command_buffer.GetHandle(), from.GetBufferHandle(), to.GetBufferHandle(), 1u, &copy_region);
+    if (regions.empty())
+        return;
+
+    std::vector<VkBufferCopy> copy_regions;
+    copy_regions.reserve(regions.size());
+    for (const BufferCopyRegion& region : regions)
+    {
+        assert(region.source_offset + region.count <= from.GetCount());
+        assert(region.destination_offset + region.count <= to.GetCount());
+        VkBufferCopy copy_region;
+        copy_region.srcOffset = region.source_offset * sizeof(T);
+        copy_region.dstOffset = region.destination_offset * sizeof(T);
+        copy_region.size = region.count * sizeof(T);
+        copy_regions.push_back(copy_region);
+    }
+
+    RequireBufferState(from.GetBufferHandle(), VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+    RequireBufferState(to.GetBufferHandle(), VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+    vkCmdCopyBuffer(
+        command_buffer.GetHandle(),
+        from.GetBufferHandle(),
+        to.GetBufferHandle(),
+        static_cast<std::uint32_t>(copy_regions.size()),
+        copy_regions.data());
+}
+
+template <typename T,
+    typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags,
+    typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+void ct::vulkan::CommandRecorder::Copy(
+    const Buffer<T, SrcMemoryType, SrcUsageFlags>&  from,
+    Buffer<T, DstMemoryType, DstUsageFlags>&        to,
+    const std::size_t                               source_offset,
+    const std::size_t                               destination_offset,
+    const std::size_t                               count)
+{
+    BufferCopyRegion region;
+    region.source_offset = source_offset;
+    region.destination_offset = destination_offset;
+    region.count = count;
+    Copy(from, to, std::vector<BufferCopyRegion>{ region });
+}
+
+template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+void ct::vulkan::CommandRecorder::CopyBufferToImage(const Buffer<T, SrcMemoryType, SrcUsageFlags>& buffer, Image& image)
+{
+    BufferImageRegion region;
+    region.image_extent = image.GetExtent();
+    CopyBufferToImage(buffer, image, std::vector<BufferImageRegion>{ region });
+}
+
+template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+void ct::vulkan::CommandRecorder::CopyBufferToImage(
+    const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+    Image&                                          image,
+    const std::vector<BufferImageRegion>&           regions)
+{
+    static_assert((SrcUsageFlags & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) != 0,
+        "Source buffer must have VK_BUFFER_USAGE_TRANSFER_SRC_BIT flag set");
+    if (regions.empty())
+        return;
+
+    const std::vector<VkBufferImageCopy> buffer_image_copies = MakeBufferImageCopies(regions, sizeof(T));
+
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+    TransitionImageLayout(image, ImageLayout::TransferDestination, TransferStage);
+    FlushBarriers();
+
+    vkCmdCopyBufferToImage(
+        command_buffer.GetHandle(),
+        buffer.GetBufferHandle(),
+        image.GetImageHandle(),
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<std::uint32_t>(buffer_image_copies.size()),
+        buffer_image_copies.data());
+}
+
+template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+void ct::vulkan::CommandRecorder::Upload(
+    const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+    Image&                                          image,
+    const ImageLayout                               final_layout,
+    const PipelineStageMask                         destination_pipe)
+{
+    CopyBufferToImage(buffer, image);
+    GenerateMipmaps(image, final_layout, destination_pipe);
 }
 
 template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
@@ -213,18 +702,66 @@ void ct::vulkan::CommandRecorder::Blit(
     const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
     const VkImage                                   image,
     const uint32_t                                  width,
-    const uint32_t                                  height)
+    const uint32_t                                  height,
+    const ImageLayout                               layout)
+{
+    BufferImageRegion region;
+    region.buffer_row_length = width;
+    region.buffer_image_height = height;
+    region.image_extent.width = width;
+    region.image_extent.height = height;
+    region.image_extent.depth = 1u;
+    Blit(buffer, image, std::vector<BufferImageRegion>{ region }, layout);
+}
+
+template <typename T, typename SrcMemoryType, VkBufferUsageFlags SrcUsageFlags>
+void ct::vulkan::CommandRecorder::Blit(
+    const Buffer<T, SrcMemoryType, SrcUsageFlags>&  buffer,
+    const VkImage                                   image,
+    const std::vector<BufferImageRegion>&           regions,
+    const ImageLayout                               layout)
 {
     static_assert((SrcUsageFlags & VK_BUFFER_USAGE_TRANSFER_SRC_BIT) != 0,
         "Source buffer must have VK_BUFFER_USAGE_TRANSFER_SRC_BIT flag set");
+    if (regions.empty())
+        return;
 
-    ImageMemoryBarrier(
+    const std::vector<VkBufferImageCopy> buffer_image_copies = MakeBufferImageCopies(regions, sizeof(T));
+
+    TrackImage(image, layout);
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+    RequireImageState(image, ImageLayout::TransferDestination, VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
+
+    vkCmdCopyBufferToImage(
+        command_buffer.GetHandle(),
+        buffer.GetBufferHandle(),
         image,
-        ImageLayout::PresentSource, TopOfPipeStage,
-        ImageLayout::TransferDestination, TransferStage);
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<std::uint32_t>(buffer_image_copies.size()),
+        buffer_image_copies.data());
+
+    RequireImageState(image, layout, 0u, BottomOfPipeStage);
+}
+
+template <typename T, typename DstMemoryType, VkBufferUsageFlags DstUsageFlags>
+void ct::vulkan::CommandRecorder::CopyImageToBuffer(
+    const VkImage                                   image,
+    const uint32_t                                  width,
+    const uint32_t                                  height,
+    Buffer<T, DstMemoryType, DstUsageFlags>&        buffer,
+    const ImageLayout                               layout)
+{
+    static_assert((DstUsageFlags & VK_BUFFER_USAGE_TRANSFER_DST_BIT) != 0,
+        "Destination buffer must have VK_BUFFER_USAGE_TRANSFER_DST_BIT flag set");
+
+    TrackImage(image, layout);
+    RequireImageState(image, ImageLayout::TransferSource, VK_ACCESS_TRANSFER_READ_BIT, TransferStage);
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_TRANSFER_WRITE_BIT, TransferStage);
+    FlushBarriers();
 
     VkBufferImageCopy buffer_image_copy = {};
-    buffer_image_copy.bufferRowLength = width; // TODO: multiply by size?
+    buffer_image_copy.bufferRowLength = width;
     buffer_image_copy.bufferImageHeight = height;
     buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     buffer_image_copy.imageSubresource.layerCount = 1u;
@@ -232,16 +769,15 @@ void ct::vulkan::CommandRecorder::Blit(
     buffer_image_copy.imageExtent.height = height;
     buffer_image_copy.imageExtent.depth = 1u;
 
-    vkCmdCopyBufferToImage(
+    vkCmdCopyImageToBuffer(
         command_buffer.GetHandle(),
-        buffer.GetBufferHandle(),
         image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        buffer.GetBufferHandle(),
         1u,
         &buffer_image_copy);
 
-    ImageMemoryBarrier(
-        image,
-        ImageLayout::TransferDestination, TransferStage,
-        ImageLayout::PresentSource, BottomOfPipeStage);
+    // Both transitions end up in the same vkCmdPipelineBarrier.
+    RequireImageState(image, layout, 0u, BottomOfPipeStage);
+    RequireBufferState(buffer.GetBufferHandle(), VK_ACCESS_HOST_READ_BIT, HostStage);
 }
@@ -0,0 +1,275 @@
+#include "completion_service.h"
+
+
+#include <algorithm>
+
+#include <vulkan/command_pool.h>
+#include <vulkan/device.h>
+#include <vulkan/exception.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+CompletionService::CompletionService(const Device& device) :
+    device(device),
+    fence_pool(device)
+{
+    if (device.SupportsTimelineSemaphores())
+    {
+        wake_semaphore = std::make_unique<TimelineSemaphore>(device, 0u);
+    }
+    thread = std::thread(&CompletionService::ServiceLoop, this);
+}
+
+CompletionService::~CompletionService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_added.notify_one();
+    thread.join();
+}
+
+void CompletionService::OnComplete(const Fence& fence, Continuation continuation)
+{
+    Pending pending;
+    pending.fence = &fence;
+    pending.continuation = std::move(continuation);
+    Register(std::move(pending));
+}
+
+void CompletionService::OnComplete(const TimelineSemaphore& semaphore, const std::uint64_t value, Continuation continuation)
+{
+    Pending pending;
+    pending.semaphore = &semaphore;
+    pending.value = value;
+    pending.continuation = std::move(continuation);
+    Register(std::move(pending));
+}
+
+std::future<void> CompletionService::WhenComplete(const Fence& fence)
+{
+    // std::function needs a copyable callable, so the promise is shared.
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+    OnComplete(fence, [promise]()
+    {
+        promise->set_value();
+    });
+    return future;
+}
+
+std::future<void> CompletionService::WhenComplete(const TimelineSemaphore& semaphore, const std::uint64_t value)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+    OnComplete(semaphore, value, [promise]()
+    {
+        promise->set_value();
+    });
+    return future;
+}
+
+void CompletionService::Submit(SubmitBatch& batch, Continuation continuation)
+{
+    if (device.SupportsTimelineSemaphores())
+    {
+        // Values must reach the queue in the order they were taken.
+        std::lock_guard<std::mutex> lock(submission_mutex);
+        SubmissionTimeline& timeline = submission_timelines[batch.GetQueue()];
+        if (timeline.semaphore == nullptr)
+        {
+            timeline.semaphore = std::make_unique<TimelineSemaphore>(device, 0u);
+        }
+        batch.Signal(*timeline.semaphore, timeline.value + 1u);
+        batch.Submit();
+        ++timeline.value;
+        OnComplete(*timeline.semaphore, timeline.value, std::move(continuation));
+    }
+    else
+    {
+        Fence& fence = fence_pool.Acquire();
+        try
+        {
+            batch.Submit(&fence);
+        }
+        catch (...)
+        {
+            fence_pool.Recycle(fence);
+            throw;
+        }
+        OnComplete(fence, [this, &fence, continuation]()
+        {
+            continuation();
+            fence_pool.Recycle(fence);
+        });
+    }
+}
+
+std::future<void> CompletionService::Submit(SubmitBatch& batch)
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    std::future<void> future = promise->get_future();
+    Submit(batch, [promise]()
+    {
+        promise->set_value();
+    });
+    return future;
+}
+
+void CompletionService::WaitIdle() const
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    work_finished.wait(lock, [this]()
+    {
+        return (pending.empty() && running_count == 0u) || error != nullptr;
+    });
+    RethrowError();
+}
+
+std::size_t CompletionService::GetPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size() + running_count;
+}
+
+void CompletionService::Register(Pending new_pending)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    RethrowError();
+    pending.push_back(std::move(new_pending));
+    // Signaled under the lock so the values stay increasing.
+    if (wake_semaphore != nullptr)
+    {
+        wake_semaphore->Signal(++wake_value);
+    }
+    work_added.notify_one();
+}
+
+void CompletionService::ServiceLoop()
+{
+    std::vector<const Fence*> fences;
+    std::vector<VkSemaphore> semaphores;
+    std::vector<std::uint64_t> values;
+    std::vector<Continuation> completed;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_added.wait(lock, [this]()
+            {
+                return stopping || !pending.empty();
+            });
+            // Outstanding work is still completed when stopping.
+            if (pending.empty())
+                return;
+
+            fences.clear();
+            semaphores.clear();
+            values.clear();
+            for (const Pending& item : pending)
+            {
+                if (item.fence != nullptr)
+                {
+                    fences.push_back(item.fence);
+                }
+                else
+                {
+                    semaphores.push_back(item.semaphore->GetHandle());
+                    values.push_back(item.value);
+                }
+            }
+            if (wake_semaphore != nullptr && !stopping)
+            {
+                semaphores.push_back(wake_semaphore->GetHandle());
+                values.push_back(wake_value + 1u);
+            }
+        }
+
+        try
+        {
+            WaitForAny(fences, semaphores, values);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto first_completed = std::stable_partition(pending.begin(), pending.end(), [this](const Pending& item)
+            {
+                return !IsComplete(item);
+            });
+            for (auto it = first_completed; it != pending.end(); ++it)
+            {
+                completed.push_back(std::move(it->continuation));
+            }
+            pending.erase(first_completed, pending.end());
+            running_count = completed.size();
+        }
+        catch (...)
+        {
+            // Dropping the continuations breaks the promises of the futures waiting for them.
+            std::lock_guard<std::mutex> lock(mutex);
+            error = std::current_exception();
+            pending.clear();
+            work_finished.notify_all();
+            return;
+        }
+
+        for (const Continuation& continuation : completed)
+        {
+            continuation();
+        }
+        completed.clear();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running_count = 0u;
+        }
+        work_finished.notify_all();
+    }
+}
+
+void CompletionService::WaitForAny(
+    const std::vector<const Fence*>&    fences,
+    const std::vector<VkSemaphore>&     semaphores,
+    const std::vector<std::uint64_t>&   values) const
+{
+    if (semaphores.empty())
+    {
+        vulkan::WaitAny(device, fences, PollTimeout);
+        return;
+    }
+
+    // Fences cannot be part of the semaphore wait, so they are polled between waits.
+    VkSemaphoreWaitInfoKHR wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    wait_info.flags = VK_SEMAPHORE_WAIT_ANY_BIT_KHR;
+    wait_info.semaphoreCount = static_cast<std::uint32_t>(semaphores.size());
+    wait_info.pSemaphores = semaphores.data();
+    wait_info.pValues = values.data();
+    const auto status = device.GetTimelineSemaphoreFunctions().wait(
+        device.GetHandle(),
+        &wait_info,
+        fences.empty() ? static_cast<std::uint64_t>(InfiniteTimeout) : static_cast<std::uint64_t>(PollTimeout));
+    if (status != VK_SUCCESS && status != VK_TIMEOUT)
+    {
+        throw Exception("Failed to wait for timeline semaphores");
+    }
+}
+
+bool CompletionService::IsComplete(const Pending& item) const
+{
+    return (item.fence != nullptr) ? item.fence->IsSignaled() : item.semaphore->IsReached(item.value);
+}
+
+void CompletionService::RethrowError() const
+{
+    if (error != nullptr)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+}
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <vulkan/synchronization.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        class SubmitBatch;
+
+
+        // A background thread that waits for GPU work on behalf of everyone else and then runs the
+        // continuations registered for it or fulfils the futures handed out for it. Continuations run on
+        // the service thread, in completion order, and must not throw.
+        //
+        // Timeline values are waited for with one wait that a host signal can interrupt, so they fire
+        // as soon as they are reached. Without timeline semaphores the thread waits on the fences with a
+        // PollTimeout so that fences registered in the meantime are picked up.
+        class CompletionService
+        {
+        public:
+            using Continuation = std::function<void()>;
+
+            explicit CompletionService(const Device& device);
+            CompletionService(const CompletionService& other) = delete;
+            // Runs the continuations of all outstanding work before returning.
+            ~CompletionService();
+
+            // The fence or semaphore has to outlive the registration.
+            void OnComplete(const Fence& fence, Continuation continuation);
+            void OnComplete(const TimelineSemaphore& semaphore, const std::uint64_t value, Continuation continuation);
+            std::future<void> WhenComplete(const Fence& fence);
+            std::future<void> WhenComplete(const TimelineSemaphore& semaphore, const std::uint64_t value);
+
+            // Submits the batch with a completion signal owned by the service: a value of its timeline
+            // semaphore, or a pooled fence that is recycled once the continuation has run.
+            void Submit(SubmitBatch& batch, Continuation continuation);
+            std::future<void> Submit(SubmitBatch& batch);
+
+            // Blocks until every registered continuation has run. Rethrows a failure of the service thread,
+            // after which the futures of the outstanding work report a broken promise.
+            void WaitIdle() const;
+            std::size_t GetPendingCount() const;
+
+            enum : std::uint64_t
+            {
+                PollTimeout = 1000000u // Nanoseconds
+            };
+
+        private:
+            struct Pending
+            {
+                const Fence*                fence = nullptr;
+                const TimelineSemaphore*    semaphore = nullptr;
+                std::uint64_t               value = 0u;
+                Continuation                continuation;
+            };
+
+            // Signals of one queue complete in submission order, which a timeline needs; submissions
+            // to different queues do not, so each queue gets its own timeline.
+            struct SubmissionTimeline
+            {
+                std::unique_ptr<TimelineSemaphore>  semaphore;
+                std::uint64_t                       value = 0u;
+            };
+
+            void Register(Pending pending);
+            void ServiceLoop();
+            void WaitForAny(
+                const std::vector<const Fence*>&    fences,
+                const std::vector<VkSemaphore>&     semaphores,
+                const std::vector<std::uint64_t>&   values) const;
+            bool IsComplete(const Pending& pending) const;
+            void RethrowError() const;
+
+            const Device&                               device;
+            FencePool                                   fence_pool;
+            std::map<VkQueue, SubmissionTimeline>       submission_timelines;
+            std::mutex                                  submission_mutex;
+
+            // Signaled from the host to interrupt the service thread's wait when work is registered.
+            std::unique_ptr<TimelineSemaphore>          wake_semaphore;
+            std::uint64_t                               wake_value = 0u;
+
+            std::vector<Pending>                        pending;
+            std::size_t                                 running_count = 0u;
+            bool                                        stopping = false;
+            std::exception_ptr                          error;
+            mutable std::mutex                          mutex;
+            std::condition_variable                     work_added;
+            mutable std::condition_variable             work_finished;
+            std::thread                                 thread;
+        };
+    }
+}
@@ -0,0 +1,198 @@
+#include "descriptor_set.h"
+
+
+#include <vulkan/device.h>
+#include <vulkan/exception.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+DescriptorSetLayout::DescriptorSetLayout(const Device& device, const std::vector<DescriptorBinding>& bindings) :
+    device(device),
+    bindings(bindings)
+{
+    std::vector<VkDescriptorSetLayoutBinding> layout_bindings;
+    layout_bindings.reserve(bindings.size());
+    for (const DescriptorBinding& binding : bindings)
+    {
+        VkDescriptorSetLayoutBinding layout_binding = {};
+        layout_binding.binding = binding.binding;
+        layout_binding.descriptorType = binding.type;
+        layout_binding.descriptorCount = binding.count;
+        layout_binding.stageFlags = binding.stages;
+        layout_bindings.push_back(layout_binding);
+    }
+
+    VkDescriptorSetLayoutCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    create_info.bindingCount = static_cast<std::uint32_t>(layout_bindings.size());
+    create_info.pBindings = layout_bindings.data();
+    if (vkCreateDescriptorSetLayout(device.GetHandle(), &create_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create descriptor set layout");
+    }
+}
+
+DescriptorSetLayout::DescriptorSetLayout(DescriptorSetLayout&& other) :
+    Object<VkDescriptorSetLayout>(std::move(other)),
+    device(other.device),
+    bindings(std::move(other.bindings))
+{
+}
+
+DescriptorSetLayout::~DescriptorSetLayout()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorSetLayout(device.GetHandle(), handle, nullptr);
+    }
+}
+
+const std::vector<DescriptorBinding>& DescriptorSetLayout::GetBindings() const
+{
+    return bindings;
+}
+
+
+DescriptorPool::DescriptorPool(
+    const Device&                           device,
+    const std::uint32_t                     max_sets,
+    const std::vector<VkDescriptorPoolSize>& sizes) :
+    device(device)
+{
+    VkDescriptorPoolCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    create_info.maxSets = max_sets;
+    create_info.poolSizeCount = static_cast<std::uint32_t>(sizes.size());
+    create_info.pPoolSizes = sizes.data();
+    if (vkCreateDescriptorPool(device.GetHandle(), &create_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create descriptor pool");
+    }
+}
+
+DescriptorPool::DescriptorPool(DescriptorPool&& other) :
+    Object<VkDescriptorPool>(std::move(other)),
+    device(other.device)
+{
+}
+
+DescriptorPool::~DescriptorPool()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyDescriptorPool(device.GetHandle(), handle, nullptr);
+    }
+}
+
+VkDescriptorSet DescriptorPool::Allocate(const DescriptorSetLayout& layout)
+{
+    return Allocate(std::vector<const DescriptorSetLayout*>{ &layout }).front();
+}
+
+std::vector<VkDescriptorSet> DescriptorPool::Allocate(const std::vector<const DescriptorSetLayout*>& layouts)
+{
+    std::vector<VkDescriptorSetLayout> layout_handles;
+    layout_handles.reserve(layouts.size());
+    for (const DescriptorSetLayout* layout : layouts)
+    {
+        layout_handles.push_back(layout->GetHandle());
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocate_info.descriptorPool = handle;
+    allocate_info.descriptorSetCount = static_cast<std::uint32_t>(layout_handles.size());
+    allocate_info.pSetLayouts = layout_handles.data();
+
+    std::vector<VkDescriptorSet> sets(layout_handles.size(), VK_NULL_HANDLE);
+    if (vkAllocateDescriptorSets(device.GetHandle(), &allocate_info, sets.data()) != VK_SUCCESS)
+    {
+        throw Exception("Failed to allocate descriptor sets");
+    }
+    return sets;
+}
+
+void DescriptorPool::Reset()
+{
+    vkResetDescriptorPool(device.GetHandle(), handle, 0u);
+}
+
+
+DescriptorWriteBatch& DescriptorWriteBatch::WriteBuffer(
+    const VkDescriptorSet   set,
+    const std::uint32_t     binding,
+    const VkDescriptorType  type,
+    const VkBuffer          buffer,
+    const VkDeviceSize      offset,
+    const VkDeviceSize      range)
+{
+    VkDescriptorBufferInfo buffer_info = {};
+    buffer_info.buffer = buffer;
+    buffer_info.offset = offset;
+    buffer_info.range = range;
+    writes.push_back({ set, binding, type, buffer_infos.size(), false });
+    buffer_infos.push_back(buffer_info);
+    return *this;
+}
+
+DescriptorWriteBatch& DescriptorWriteBatch::WriteImage(
+    const VkDescriptorSet   set,
+    const std::uint32_t     binding,
+    const VkDescriptorType  type,
+    const VkImageView       image_view,
+    const VkImageLayout     layout,
+    const VkSampler         sampler)
+{
+    VkDescriptorImageInfo image_info = {};
+    image_info.sampler = sampler;
+    image_info.imageView = image_view;
+    image_info.imageLayout = layout;
+    writes.push_back({ set, binding, type, image_infos.size(), true });
+    image_infos.push_back(image_info);
+    return *this;
+}
+
+void DescriptorWriteBatch::Update(const Device& device)
+{
+    if (writes.empty())
+        return;
+
+    std::vector<VkWriteDescriptorSet> descriptor_writes;
+    descriptor_writes.reserve(writes.size());
+    for (const Write& write : writes)
+    {
+        VkWriteDescriptorSet descriptor_write = {};
+        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet = write.set;
+        descriptor_write.dstBinding = write.binding;
+        descriptor_write.descriptorCount = 1u;
+        descriptor_write.descriptorType = write.type;
+        if (write.is_image)
+            descriptor_write.pImageInfo = &image_infos[write.info_index];
+        else
+            descriptor_write.pBufferInfo = &buffer_infos[write.info_index];
+        descriptor_writes.push_back(descriptor_write);
+    }
+    vkUpdateDescriptorSets(
+        device.GetHandle(),
+        static_cast<std::uint32_t>(descriptor_writes.size()),
+        descriptor_writes.data(),
+        0u,
+        nullptr);
+
+    writes.clear();
+    buffer_infos.clear();
+    image_infos.clear();
+}
+
+bool DescriptorWriteBatch::IsEmpty() const
+{
+    return writes.empty();
+}
+
+}
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        class Device;
+
+
+        struct DescriptorBinding
+        {
+            std::uint32_t       binding = 0u;
+            VkDescriptorType    type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            std::uint32_t       count = 1u;
+            VkShaderStageFlags  stages = VK_SHADER_STAGE_COMPUTE_BIT;
+        };
+
+
+        class DescriptorSetLayout : public Object<VkDescriptorSetLayout>
+        {
+        public:
+            explicit DescriptorSetLayout(const Device& device, const std::vector<DescriptorBinding>& bindings);
+            DescriptorSetLayout(DescriptorSetLayout&& other);
+            ~DescriptorSetLayout();
+
+            const std::vector<DescriptorBinding>& GetBindings() const;
+
+        private:
+            const Device&                   device;
+            std::vector<DescriptorBinding>  bindings;
+        };
+
+
+        // Sets are never freed one by one; the whole pool is reset once none of them is in use any more,
+        // e.g. one pool per frame in flight.
+        class DescriptorPool : public Object<VkDescriptorPool>
+        {
+        public:
+            explicit DescriptorPool(
+                const Device&                           device,
+                const std::uint32_t                     max_sets,
+                const std::vector<VkDescriptorPoolSize>& sizes);
+            DescriptorPool(DescriptorPool&& other);
+            ~DescriptorPool();
+
+            VkDescriptorSet Allocate(const DescriptorSetLayout& layout);
+            std::vector<VkDescriptorSet> Allocate(const std::vector<const DescriptorSetLayout*>& layouts);
+            void Reset();
+
+        private:
+            const Device& device;
+        };
+
+
+        // Collects descriptor writes and applies them with a single vkUpdateDescriptorSets. The sets
+        // must not be in use by pending command buffers when Update() is called.
+        class DescriptorWriteBatch
+        {
+        public:
+            DescriptorWriteBatch& WriteBuffer(
+                const VkDescriptorSet   set,
+                const std::uint32_t     binding,
+                const VkDescriptorType  type,
+                const VkBuffer          buffer,
+                const VkDeviceSize      offset = 0u,
+                const VkDeviceSize      range = VK_WHOLE_SIZE);
+            DescriptorWriteBatch& WriteImage(
+                const VkDescriptorSet   set,
+                const std::uint32_t     binding,
+                const VkDescriptorType  type,
+                const VkImageView       image_view,
+                const VkImageLayout     layout,
+                const VkSampler         sampler = VK_NULL_HANDLE);
+
+            void Update(const Device& device);
+            bool IsEmpty() const;
+
+        private:
+            struct Write
+            {
+                VkDescriptorSet     set;
+                std::uint32_t       binding;
+                VkDescriptorType    type;
+                std::size_t         info_index;
+                bool                is_image;
+            };
+
+            // The infos are only pointed to when the writes are applied, so the vectors may grow until then.
+            std::vector<Write>                  writes;
+            std::vector<VkDescriptorBufferInfo> buffer_infos;
+            std::vector<VkDescriptorImageInfo>  image_infos;
+        };
+    }
+}
@@ -1,8 +1,57 @@
 #include "device.h"
 
-#include <unordered_set>
+#include <algorithm>
+#include <cstring>
 
+#include <vulkan/allocator.h>
 #include <vulkan/instance.h>
+#include <vulkan/pipeline_cache.h>
+
+
+namespace
+{
+    // Graphics and compute families can always transfer, even when they do not report it.
+    VkQueueFlags GetQueueCapabilities(const VkQueueFamilyProperties& queue_family)
+    {
+        VkQueueFlags capabilities = queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+        if (capabilities & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
+            capabilities |= VK_QUEUE_TRANSFER_BIT;
+        return capabilities;
+    }
+
+    std::uint32_t CountCapabilities(const VkQueueFlags capabilities)
+    {
+        std::uint32_t count = 0u;
+        for (VkQueueFlags remaining = capabilities; remaining != 0u; remaining &= remaining - 1u)
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    // The family that has the required capability and as few others as possible, e.g. a compute-only
+    // family for async compute or a copy-engine family for transfers. Ties go to the lower index.
+    std::uint32_t FindDedicatedQueueFamily(
+        const std::vector<VkQueueFamilyProperties>& queue_families,
+        const VkQueueFlags                          required_capability)
+    {
+        std::uint32_t best_family_index = ct::vulkan::Device::InvalidQueueFamilyIndex;
+        std::uint32_t best_capability_count = ~0u;
+        for (std::uint32_t family_index = 0u; family_index != queue_families.size(); ++family_index)
+        {
+            const VkQueueFlags capabilities = GetQueueCapabilities(queue_families[family_index]);
+            if (queue_families[family_index].queueCount == 0u || (capabilities & required_capability) == 0u)
+                continue;
+            const std::uint32_t capability_count = CountCapabilities(capabilities);
+            if (capability_count < best_capability_count)
+            {
+                best_family_index = family_index;
+                best_capability_count = capability_count;
+            }
+        }
+        return best_family_index;
+    }
+}
 
 
 namespace ct
@@ -10,11 +59,12 @@ namespace ct
 namespace vulkan
 {
 
-const std::array<QueueType, 3>& AllQueueTypes()
+const std::array<QueueType, 4>& AllQueueTypes()
 {
-    static constexpr std::array<QueueType, 3> all_queue_types = {
+    static constexpr std::array<QueueType, 4> all_queue_types = {
         ComputeQueue,
         GraphicsQueue,
+        TransferQueue,
         PresentQueue
     };
     return all_queue_types;
@@ -25,7 +75,8 @@ Device::Device(
     const Instance&             vk_instance,
     const VkPhysicalDevice      physical_device,
     QueueFlags                  requested_queue_flags,
-    const VkSurfaceKHR          surface) :
+    const VkSurfaceKHR          surface,
+    const std::string&          pipeline_cache_path) :
     physical_device(physical_device),
     surface(surface)
 {
@@ -33,78 +84,138 @@ Device::Device(
     assert(((requested_queue_flags & PresentQueue) == 0u) == (surface == VK_NULL_HANDLE));
     requested_queue_flags &= ~PresentQueue;
 
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    std::uint32_t extension_count = 0u;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    supported_extensions.resize(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, supported_extensions.data());
+
     std::uint32_t queue_family_count = 0u;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
-    std::vector<VkQueueFamilyProperties> queue_families(queue_family_count);
+    queue_families.resize(queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queue_families.data());
 
-    std::uint32_t current_queue_index = 0u;
-    for (const VkQueueFamilyProperties& queue_family : queue_families)
+    std::vector<VkBool32> present_support(queue_families.size(), VK_FALSE);
+    if (surface != VK_NULL_HANDLE)
     {
-        if (queue_family.queueCount > 0)
+        for (std::uint32_t family_index = 0u; family_index != queue_family_count; ++family_index)
         {
-            if (requested_queue_flags & queue_family.queueFlags & GraphicsQueue)
-                queues_info.graphics_queue_family_index = current_queue_index;
-            if (requested_queue_flags & queue_family.queueFlags & ComputeQueue)
-                queues_info.compute_queue_family_index = current_queue_index;
-            if (surface != VK_NULL_HANDLE)
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, family_index, surface, &present_support[family_index]);
+        }
+    }
+
+    // Presenting from the graphics family saves an ownership transfer of every swapchain image.
+    QueueInfo& graphics_info = queues_info[GetQueueSlot(GraphicsQueue)];
+    if (requested_queue_flags & GraphicsQueue)
+    {
+        for (std::uint32_t family_index = 0u; family_index != queue_family_count; ++family_index)
+        {
+            if (queue_families[family_index].queueCount == 0u || (queue_families[family_index].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0u)
+                continue;
+            if (graphics_info.family_index == InvalidQueueFamilyIndex ||
+                (present_support[family_index] && !present_support[graphics_info.family_index]))
             {
-                VkBool32 present_support = false;
-                vkGetPhysicalDeviceSurfaceSupportKHR(
-                    physical_device,
-                    current_queue_index,
-                    surface,
-                    &present_support);
-                if (present_support)
-                {
-                    queues_info.present_queue_family_index = current_queue_index;
-                }
+                graphics_info.family_index = family_index;
             }
         }
-        ++current_queue_index;
+    }
+    if (requested_queue_flags & ComputeQueue)
+        queues_info[GetQueueSlot(ComputeQueue)].family_index = FindDedicatedQueueFamily(queue_families, VK_QUEUE_COMPUTE_BIT);
+    if (requested_queue_flags & TransferQueue)
+        queues_info[GetQueueSlot(TransferQueue)].family_index = FindDedicatedQueueFamily(queue_families, VK_QUEUE_TRANSFER_BIT);
+    QueueInfo& present_info = queues_info[GetQueueSlot(PresentQueue)];
+    if (surface != VK_NULL_HANDLE)
+    {
+        if (graphics_info.family_index != InvalidQueueFamilyIndex && present_support[graphics_info.family_index])
+        {
+            present_info.family_index = graphics_info.family_index;
+        }
+        else
+        {
+            const auto present_family = std::find(present_support.cbegin(), present_support.cend(), VK_TRUE);
+            if (present_family != present_support.cend())
+                present_info.family_index = static_cast<std::uint32_t>(present_family - present_support.cbegin());
+        }
     }
 
-    if (queues_info.compute_queue_family_index == ~0u && (requested_queue_flags & ComputeQueue))
+    if (queues_info[GetQueueSlot(ComputeQueue)].family_index == ~0u && (requested_queue_flags & ComputeQueue))
         throw Exception("Compute queue was requested, but it is not supported by the device");
-    if (queues_info.graphics_queue_family_index == ~0u && (requested_queue_flags & GraphicsQueue))
+    if (graphics_info.family_index == ~0u && (requested_queue_flags & GraphicsQueue))
         throw Exception("Graphics queue was requested, but it is not supported by the device");
-    if (queues_info.present_queue_family_index == ~0u && surface != VK_NULL_HANDLE)
+    if (queues_info[GetQueueSlot(TransferQueue)].family_index == ~0u && (requested_queue_flags & TransferQueue))
+        throw Exception("Transfer queue was requested, but it is not supported by the device");
+    if (present_info.family_index == ~0u && surface != VK_NULL_HANDLE)
         throw Exception("Present queue was requested, but it is not supported by the device");
 
-    std::unordered_set<std::uint32_t> queue_indices = {
-        queues_info.compute_queue_family_index,
-        queues_info.graphics_queue_family_index,
-        queues_info.present_queue_family_index
-    };
+    // Each queue type takes the next free queue of its family and shares the last one when the
+    // family runs out. Presenting uses the graphics queue when they are in the same family.
+    std::vector<std::uint32_t> family_queue_counts(queue_families.size(), 0u);
+    for (const QueueType type : { GraphicsQueue, ComputeQueue, TransferQueue })
+    {
+        QueueInfo& queue_info = queues_info[GetQueueSlot(type)];
+        if (queue_info.family_index == InvalidQueueFamilyIndex) continue;
+        std::uint32_t& used_queue_count = family_queue_counts[queue_info.family_index];
+        queue_info.queue_index = std::min(used_queue_count, queue_families[queue_info.family_index].queueCount - 1u);
+        used_queue_count = queue_info.queue_index + 1u;
+    }
+    if (present_info.family_index != InvalidQueueFamilyIndex)
+    {
+        if (present_info.family_index == graphics_info.family_index)
+            present_info.queue_index = graphics_info.queue_index;
+        else
+            family_queue_counts[present_info.family_index] = std::max(family_queue_counts[present_info.family_index], 1u);
+    }
+
+    const std::vector<float> queue_priorities(
+        *std::max_element(family_queue_counts.cbegin(), family_queue_counts.cend()), 1.0f);
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
-    for (std::uint32_t queue_index : queue_indices)
+    for (std::uint32_t family_index = 0u; family_index != queue_family_count; ++family_index)
     {
-        if (queue_index == ~0u) continue;
+        if (family_queue_counts[family_index] == 0u) continue;
         VkDeviceQueueCreateInfo queue_create_info = {};
-        float queue_priority = 1.0f;
         queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queue_create_info.queueFamilyIndex = queue_index;
-        queue_create_info.queueCount = 1;
-        queue_create_info.pQueuePriorities = &queue_priority;
+        queue_create_info.queueFamilyIndex = family_index;
+        queue_create_info.queueCount = family_queue_counts[family_index];
+        queue_create_info.pQueuePriorities = queue_priorities.data();
         queue_create_infos.push_back(queue_create_info);
     }
 
     VkPhysicalDeviceFeatures deviceFeatures = {};
 
+    // The feature is queried through vkGetPhysicalDeviceFeatures2 which is core in Vulkan 1.1.
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features = {};
+    timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    if (properties.apiVersion >= VK_API_VERSION_1_1 && IsExtensionSupported(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2 features = {};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &timeline_semaphore_features;
+        vkGetPhysicalDeviceFeatures2(physical_device, &features);
+        timeline_semaphore_features.pNext = nullptr;
+    }
+
     VkDeviceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     create_info.queueCreateInfoCount = static_cast<std::uint32_t>(queue_create_infos.size());
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.pEnabledFeatures = &deviceFeatures;
-    if (queues_info.present_queue_family_index != ~0u)
+    if (present_info.family_index != ~0u)
     {
-        create_info.enabledExtensionCount = static_cast<std::uint32_t>(present_mode_extensions.size());
-        create_info.ppEnabledExtensionNames = present_mode_extensions.data();
+        enabled_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     }
-    else
+    // Memory budget is queried through vkGetPhysicalDeviceMemoryProperties2 which is core in Vulkan 1.1.
+    if (properties.apiVersion >= VK_API_VERSION_1_1 && IsExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        enabled_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+    if (timeline_semaphore_features.timelineSemaphore == VK_TRUE)
     {
-        create_info.enabledExtensionCount = 0;
+        enabled_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        create_info.pNext = &timeline_semaphore_features;
     }
+    create_info.enabledExtensionCount = static_cast<std::uint32_t>(enabled_extensions.size());
+    create_info.ppEnabledExtensionNames = enabled_extensions.empty() ? nullptr : enabled_extensions.data();
     if (vk_instance.validation_layer_enabled)
     {
         create_info.enabledLayerCount = static_cast<std::uint32_t>(vk_instance.validation_layer_names.size());
@@ -120,17 +231,40 @@ Device::Device(
         throw Exception("Failed to create logical device");
     }
 
-    if (queues_info.graphics_queue_family_index != ~0u)
-        vkGetDeviceQueue(handle, queues_info.graphics_queue_family_index, 0, &queues_info.graphics_queue);
-    if (queues_info.present_queue_family_index != ~0u)
-        vkGetDeviceQueue(handle, queues_info.present_queue_family_index, 0, &queues_info.present_queue);
-    if (queues_info.compute_queue_family_index != ~0u)
-        vkGetDeviceQueue(handle, queues_info.compute_queue_family_index, 0, &queues_info.compute_queue);
+    for (QueueInfo& queue_info : queues_info)
+    {
+        if (queue_info.family_index != ~0u)
+            vkGetDeviceQueue(handle, queue_info.family_index, queue_info.queue_index, &queue_info.queue);
+    }
+
+    if (IsExtensionEnabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))
+    {
+        timeline_semaphore_functions.get_counter_value = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+            vkGetDeviceProcAddr(handle, "vkGetSemaphoreCounterValueKHR"));
+        timeline_semaphore_functions.wait = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+            vkGetDeviceProcAddr(handle, "vkWaitSemaphoresKHR"));
+        timeline_semaphore_functions.signal = reinterpret_cast<PFN_vkSignalSemaphoreKHR>(
+            vkGetDeviceProcAddr(handle, "vkSignalSemaphoreKHR"));
+        if (timeline_semaphore_functions.get_counter_value == nullptr ||
+            timeline_semaphore_functions.wait == nullptr ||
+            timeline_semaphore_functions.signal == nullptr)
+        {
+            throw Exception("Failed to load timeline semaphore functions");
+        }
+    }
 
-    if (queues_info.present_queue_family_index != ~0u)
+    if (present_info.family_index != ~0u)
     {
         vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surface_capabilities);
     }
+
+    allocator = std::make_unique<MemoryAllocator>(
+        handle,
+        physical_device,
+        properties.limits.nonCoherentAtomSize,
+        IsExtensionEnabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME));
+
+    pipeline_cache = std::make_unique<PipelineCache>(handle, properties, pipeline_cache_path);
 }
 
 
@@ -138,10 +272,17 @@ Device::Device(Device&& other) :
     Object<VkDevice>(std::move(other)),
     physical_device(other.physical_device),
     surface(other.surface),
+    properties(other.properties),
     present_modes(other.present_modes),
     surface_formats(std::move(other.surface_formats)),
     surface_capabilities(other.surface_capabilities),
-    queues_info(other.queues_info)
+    queues_info(other.queues_info),
+    queue_families(std::move(other.queue_families)),
+    supported_extensions(std::move(other.supported_extensions)),
+    enabled_extensions(std::move(other.enabled_extensions)),
+    timeline_semaphore_functions(other.timeline_semaphore_functions),
+    allocator(std::move(other.allocator)),
+    pipeline_cache(std::move(other.pipeline_cache))
 {
 }
 
@@ -152,6 +293,12 @@ VkPhysicalDevice Device::GetPhysicalDevice() const
 }
 
 
+const VkPhysicalDeviceProperties& Device::GetProperties() const
+{
+    return properties;
+}
+
+
 VkSurfaceKHR Device::GetSurface() const
 {
     return surface;
@@ -160,60 +307,80 @@ VkSurfaceKHR Device::GetSurface() const
 
 bool Device::Supports(const QueueType type) const
 {
-    switch (type)
-    {
-    case GraphicsQueue:
-        return queues_info.graphics_queue != VK_NULL_HANDLE;
-    case ComputeQueue:
-        return queues_info.compute_queue != VK_NULL_HANDLE;
-    case PresentQueue:
-        return queues_info.present_queue != VK_NULL_HANDLE;
-    default:
-        assert(false);
-        return false;
-    }
+    return GetQueueInfo(type).queue != VK_NULL_HANDLE;
 }
 
 
 VkQueue Device::GetQueue(const QueueType type) const
 {
     assert(Supports(type));
-    switch (type)
-    {
-    case GraphicsQueue:
-        return queues_info.graphics_queue;
-    case ComputeQueue:
-        return queues_info.compute_queue;
-    case PresentQueue:
-        return queues_info.present_queue;
-    default:
-        assert(false);
-        return VK_NULL_HANDLE;
-    }
+    return GetQueueInfo(type).queue;
 }
 
 
 std::uint32_t Device::GetQueueFamilyIndex(const QueueType type) const
 {
     assert(Supports(type));
+    return GetQueueInfo(type).family_index;
+}
+
+
+std::uint32_t Device::GetQueueIndex(const QueueType type) const
+{
+    assert(Supports(type));
+    return GetQueueInfo(type).queue_index;
+}
+
+
+const VkQueueFamilyProperties& Device::GetQueueFamilyProperties(const QueueType type) const
+{
+    assert(Supports(type));
+    return queue_families[GetQueueInfo(type).family_index];
+}
+
+
+bool Device::SharesQueue(const QueueType a, const QueueType b) const
+{
+    return GetQueue(a) == GetQueue(b);
+}
+
+
+bool Device::SharesQueueFamily(const QueueType a, const QueueType b) const
+{
+    return GetQueueFamilyIndex(a) == GetQueueFamilyIndex(b);
+}
+
+
+std::size_t Device::GetQueueSlot(const QueueType type)
+{
     switch (type)
     {
-    case GraphicsQueue:
-        return queues_info.graphics_queue_family_index;
     case ComputeQueue:
-        return queues_info.compute_queue_family_index;
+        return 0u;
+    case GraphicsQueue:
+        return 1u;
+    case TransferQueue:
+        return 2u;
     case PresentQueue:
-        return queues_info.present_queue_family_index;
+        return 3u;
     default:
         assert(false);
-        return InvalidQueueFamilyIndex;
+        return 0u;
     }
 }
 
 
+const Device::QueueInfo& Device::GetQueueInfo(const QueueType type) const
+{
+    return queues_info[GetQueueSlot(type)];
+}
+
+
 const VkSurfaceCapabilitiesKHR& Device::GetSurfaceCapabilities() const
 {
     assert(Supports(PresentQueue));
+    // The current extent follows the window, so it is queried again for every swapchain.
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surface_capabilities);
     return surface_capabilities;
 }
 
@@ -266,6 +433,67 @@ const std::vector<VkPresentModeKHR>& Device::GetPresentModes() const
 }
 
 
+bool Device::IsExtensionEnabled(const char* name) const
+{
+    return std::find_if(enabled_extensions.cbegin(), enabled_extensions.cend(),
+        [name](const char* enabled_extension)
+    {
+        return std::strcmp(enabled_extension, name) == 0;
+    }) != enabled_extensions.cend();
+}
+
+
+bool Device::SupportsTimelineSemaphores() const
+{
+    return timeline_semaphore_functions.wait != nullptr;
+}
+
+
+const Device::TimelineSemaphoreFunctions& Device::GetTimelineSemaphoreFunctions() const
+{
+    assert(SupportsTimelineSemaphores());
+    return timeline_semaphore_functions;
+}
+
+
+bool Device::IsExtensionSupported(const char* name) const
+{
+    return std::find_if(supported_extensions.cbegin(), supported_extensions.cend(),
+        [name](const VkExtensionProperties& extension)
+    {
+        return std::strcmp(extension.extensionName, name) == 0;
+    }) != supported_extensions.cend();
+}
+
+
+MemoryAllocator& Device::GetAllocator() const
+{
+    assert(allocator != nullptr);
+    return *allocator;
+}
+
+
+VkPipelineCache Device::GetPipelineCache() const
+{
+    assert(pipeline_cache != nullptr);
+    return pipeline_cache->GetHandle();
+}
+
+
+bool Device::IsPipelineCacheWarm() const
+{
+    assert(pipeline_cache != nullptr);
+    return pipeline_cache->IsWarm();
+}
+
+
+bool Device::SavePipelineCache() const
+{
+    assert(pipeline_cache != nullptr);
+    return pipeline_cache->Save();
+}
+
+
 Device::~Device()
 {
     if (handle != VK_NULL_HANDLE)
@@ -274,6 +502,8 @@ Device::~Device()
         {
             if (Supports(queue_type)) vkQueueWaitIdle(GetQueue(queue_type));
         }
+        pipeline_cache.reset();
+        allocator.reset();
         vkDestroyDevice(handle, nullptr);
     }
 }
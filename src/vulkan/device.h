@@ -2,6 +2,8 @@
 
 
 #include <array>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include <vulkan/object.h>
@@ -13,17 +15,20 @@ namespace vulkan
 {
 
 class Instance;
+class MemoryAllocator;
+class PipelineCache;
 
 
 enum QueueType : std::uint32_t
 {
     ComputeQueue = VK_QUEUE_COMPUTE_BIT,
     GraphicsQueue = VK_QUEUE_GRAPHICS_BIT,
+    TransferQueue = VK_QUEUE_TRANSFER_BIT,
     PresentQueue = VK_QUEUE_PROTECTED_BIT
 };
 
 
-const std::array<QueueType, 3>& AllQueueTypes();
+const std::array<QueueType, 4>& AllQueueTypes();
 
 
 using QueueFlags = std::uint32_t;
@@ -36,7 +41,8 @@ public:
         const Instance&             vk_instance,
         const VkPhysicalDevice      physical_device,
         QueueFlags                  requested_queue_flags,
-        const VkSurfaceKHR          surface = VK_NULL_HANDLE);
+        const VkSurfaceKHR          surface = VK_NULL_HANDLE,
+        const std::string&          pipeline_cache_path = std::string());
     Device(Device&& other);
 
     enum : std::uint32_t
@@ -45,42 +51,81 @@ public:
     };
 
     VkPhysicalDevice GetPhysicalDevice() const;
+    const VkPhysicalDeviceProperties& GetProperties() const;
     VkSurfaceKHR GetSurface() const;
 
     bool Supports(const QueueType type) const;
 
+    // Compute and transfer queues come from dedicated families when the device has them and get
+    // their own queue when the family has enough of them. Otherwise they fall back to the graphics
+    // queue, so work meant to overlap simply runs in order.
     VkQueue GetQueue(const QueueType type) const;
     std::uint32_t GetQueueFamilyIndex(const QueueType type) const;
+    std::uint32_t GetQueueIndex(const QueueType type) const;
+    const VkQueueFamilyProperties& GetQueueFamilyProperties(const QueueType type) const;
+
+    // Submissions to one VkQueue execute in order; only distinct queues can overlap.
+    bool SharesQueue(const QueueType a, const QueueType b) const;
+    // Exclusive resources used on queues of different families need ownership transfers.
+    bool SharesQueueFamily(const QueueType a, const QueueType b) const;
 
     const VkSurfaceCapabilitiesKHR& GetSurfaceCapabilities() const;
     const std::vector<VkSurfaceFormatKHR>& GetSurfaceFormats() const;
     const std::vector<VkPresentModeKHR>& GetPresentModes() const;
 
+    bool IsExtensionEnabled(const char* name) const;
+
+    // Host commands of VK_KHR_timeline_semaphore. The instance targets Vulkan 1.1, so they are loaded
+    // from the extension rather than used from core 1.2.
+    struct TimelineSemaphoreFunctions
+    {
+        PFN_vkGetSemaphoreCounterValueKHR   get_counter_value = nullptr;
+        PFN_vkWaitSemaphoresKHR             wait = nullptr;
+        PFN_vkSignalSemaphoreKHR            signal = nullptr;
+    };
+
+    bool SupportsTimelineSemaphores() const;
+    const TimelineSemaphoreFunctions& GetTimelineSemaphoreFunctions() const;
+
+    MemoryAllocator& GetAllocator() const;
+
+    // Loaded from the file given at construction, if it was written for this device and driver, and
+    // saved back by SavePipelineCache(). Without a path the cache lives in memory only.
+    VkPipelineCache GetPipelineCache() const;
+    bool IsPipelineCacheWarm() const;
+    bool SavePipelineCache() const;
+
     ~Device();
 
 private:
     const VkPhysicalDevice      physical_device;
     const VkSurfaceKHR          surface;
+    VkPhysicalDeviceProperties  properties;
 
     mutable std::vector<VkPresentModeKHR>       present_modes;
     mutable std::vector<VkSurfaceFormatKHR>     surface_formats;
-    VkSurfaceCapabilitiesKHR                    surface_capabilities;
+    mutable VkSurfaceCapabilitiesKHR            surface_capabilities;
 
-    struct QueuesInfo
+    struct QueueInfo
     {
-        VkQueue graphics_queue = VK_NULL_HANDLE;
-        std::uint32_t graphics_queue_family_index = InvalidQueueFamilyIndex;
-        VkQueue present_queue = VK_NULL_HANDLE;
-        std::uint32_t present_queue_family_index = InvalidQueueFamilyIndex;
-        VkQueue compute_queue = VK_NULL_HANDLE;
-        std::uint32_t compute_queue_family_index = InvalidQueueFamilyIndex;
+        VkQueue queue = VK_NULL_HANDLE;
+        std::uint32_t family_index = InvalidQueueFamilyIndex;
+        std::uint32_t queue_index = 0u;
     };
-    QueuesInfo queues_info;
+    std::array<QueueInfo, 4>                queues_info;
+    std::vector<VkQueueFamilyProperties>    queue_families;
 
-    const std::array<const char*, 1> present_mode_extensions =
-    {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME
-    };
+    static std::size_t GetQueueSlot(const QueueType type);
+    const QueueInfo& GetQueueInfo(const QueueType type) const;
+
+    bool IsExtensionSupported(const char* name) const;
+
+    std::vector<VkExtensionProperties>  supported_extensions;
+    std::vector<const char*>            enabled_extensions;
+    TimelineSemaphoreFunctions          timeline_semaphore_functions;
+
+    std::unique_ptr<MemoryAllocator>    allocator;
+    std::unique_ptr<PipelineCache>      pipeline_cache;
 };
 
 }
@@ -0,0 +1,967 @@
+#include "frame_graph.h"
+
+
+#include <algorithm>
+#include <utility>
+
+#include <vulkan/exception.h>
+
+
+namespace
+{
+    const char* const FrameGraphTag = "frame graph";
+
+    VkImageUsageFlags GetImageUsage(const ct::vulkan::ImageLayout layout)
+    {
+        switch (layout)
+        {
+        case ct::vulkan::ImageLayout::General:
+            return VK_IMAGE_USAGE_STORAGE_BIT;
+        case ct::vulkan::ImageLayout::ColorAttachment:
+            return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ct::vulkan::ImageLayout::ShaderReadOnly:
+            return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ct::vulkan::ImageLayout::TransferSource:
+            return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case ct::vulkan::ImageLayout::TransferDestination:
+            return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        default:
+            return 0u;
+        }
+    }
+
+    template <typename T>
+    void PushBackUnique(std::vector<T>& container, const T& element)
+    {
+        if (std::find(container.cbegin(), container.cend(), element) == container.cend())
+        {
+            container.push_back(element);
+        }
+    }
+
+    template <typename T>
+    bool RemoveIfPresent(std::vector<T>& container, const T& element)
+    {
+        auto position = std::find(container.begin(), container.end(), element);
+        if (position == container.end())
+            return false;
+        container.erase(position);
+        return true;
+    }
+}
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+FrameGraph::PassBuilder::PassBuilder(FrameGraph& graph, const std::size_t pass_index) :
+    graph(graph),
+    pass_index(pass_index)
+{
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::ReadImage(
+    const ResourceHandle    image,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    assert(graph.resources[image].is_image);
+    return AddUse(image, layout, access, stages, false);
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::WriteImage(
+    const ResourceHandle    image,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    assert(graph.resources[image].is_image);
+    return AddUse(image, layout, access, stages, true);
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::ReadBuffer(
+    const ResourceHandle    buffer,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    assert(!graph.resources[buffer].is_image);
+    return AddUse(buffer, ImageLayout::Undefined, access, stages, false);
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::WriteBuffer(
+    const ResourceHandle    buffer,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages)
+{
+    assert(!graph.resources[buffer].is_image);
+    return AddUse(buffer, ImageLayout::Undefined, access, stages, true);
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::NeverCull()
+{
+    graph.passes[pass_index].never_culled = true;
+    return *this;
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::AddUse(
+    const ResourceHandle    resource,
+    const ImageLayout       layout,
+    const VkAccessFlags     access,
+    const PipelineStageMask stages,
+    const bool              is_write)
+{
+    assert(!graph.compiled);
+    assert(resource < graph.resources.size());
+    ResourceUse use;
+    use.resource = resource;
+    use.layout = layout;
+    use.access = access;
+    use.stages = stages;
+    use.is_write = is_write;
+    graph.passes[pass_index].uses.push_back(use);
+    return *this;
+}
+
+
+
+FrameGraph::FrameGraph(const Device& device) :
+    device(device)
+{
+}
+
+FrameGraph::~FrameGraph()
+{
+    for (const Resource& resource : resources)
+    {
+        if (resource.is_imported)
+            continue;
+        if (resource.vk_image_view != VK_NULL_HANDLE)
+            vkDestroyImageView(device.GetHandle(), resource.vk_image_view, nullptr);
+        if (resource.vk_image != VK_NULL_HANDLE)
+            vkDestroyImage(device.GetHandle(), resource.vk_image, nullptr);
+    }
+    for (const MemoryAllocation& allocation : memory_slots)
+    {
+        device.GetAllocator().Free(allocation);
+    }
+}
+
+FrameGraph::ResourceHandle FrameGraph::CreateImage(const std::string& name, const VkFormat format, const VkExtent3D& extent)
+{
+    assert(!compiled);
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.format = format;
+    resource.extent = extent;
+    resources.push_back(std::move(resource));
+    return resources.size() - 1u;
+}
+
+FrameGraph::ResourceHandle FrameGraph::ImportImage(
+    const std::string&      name,
+    const VkImage           image,
+    const ImageLayout       initial_layout,
+    const ImageLayout       final_layout)
+{
+    assert(!compiled);
+    Resource resource;
+    resource.name = name;
+    resource.is_image = true;
+    resource.is_imported = true;
+    resource.vk_image = image;
+    resource.initial_layout = initial_layout;
+    resource.final_layout = final_layout;
+    resources.push_back(std::move(resource));
+    return resources.size() - 1u;
+}
+
+FrameGraph::ResourceHandle FrameGraph::ImportBuffer(const std::string& name, const VkBuffer buffer)
+{
+    assert(!compiled);
+    Resource resource;
+    resource.name = name;
+    resource.is_imported = true;
+    resource.vk_buffer = buffer;
+    resources.push_back(std::move(resource));
+    return resources.size() - 1u;
+}
+
+void FrameGraph::SetImportedImage(const ResourceHandle image, const VkImage vk_image)
+{
+    assert(resources[image].is_imported && resources[image].is_image);
+    resources[image].vk_image = vk_image;
+}
+
+void FrameGraph::SetImportedBuffer(const ResourceHandle buffer, const VkBuffer vk_buffer)
+{
+    assert(resources[buffer].is_imported && !resources[buffer].is_image);
+    resources[buffer].vk_buffer = vk_buffer;
+}
+
+FrameGraph::PassBuilder FrameGraph::AddPass(const std::string& name, const QueueType queue_type, ExecuteFunction execute)
+{
+    assert(!compiled);
+    assert(queue_type != PresentQueue && device.Supports(queue_type));
+    Pass pass;
+    pass.name = name;
+    pass.queue_type = queue_type;
+    pass.execute = std::move(execute);
+    passes.push_back(std::move(pass));
+    return PassBuilder(*this, passes.size() - 1u);
+}
+
+void FrameGraph::Compile()
+{
+    assert(!compiled);
+    const std::vector<std::size_t> schedule = SchedulePasses(CullPasses());
+
+    // Consecutive passes on one queue are recorded into one command buffer and submitted together.
+    for (std::size_t position = 0u; position != schedule.size(); ++position)
+    {
+        const Pass& pass = passes[schedule[position]];
+        const QueueType queue_type = ResolveQueueType(pass.queue_type);
+        if (submissions.empty() || submissions.back().queue_type != queue_type)
+        {
+            Submission submission;
+            submission.queue_type = queue_type;
+            submissions.push_back(std::move(submission));
+        }
+        submissions.back().passes.push_back(schedule[position]);
+
+        for (const ResourceUse& use : pass.uses)
+        {
+            Resource& resource = resources[use.resource];
+            if (resource.first_use == None)
+                resource.first_use = position;
+            resource.last_use = position;
+            PushBackUnique(resource.queue_types, queue_type);
+        }
+    }
+
+    CreateTransientImages(schedule);
+    PlanSynchronization();
+
+    command_buffers.reserve(submissions.size());
+    for (const Submission& submission : submissions)
+    {
+        auto pool = std::find_if(command_pools.cbegin(), command_pools.cend(),
+            [&submission](const std::unique_ptr<CommandPool>& command_pool)
+        {
+            return command_pool->GetQueueType() == submission.queue_type;
+        });
+        if (pool == command_pools.cend())
+        {
+            command_pools.push_back(std::make_unique<CommandPool>(device, submission.queue_type, ResettableCommandBuffers));
+            pool = command_pools.cend() - 1;
+        }
+        command_buffers.emplace_back(**pool);
+    }
+    compiled = true;
+}
+
+void FrameGraph::Execute(
+    const Semaphore*        wait_semaphore,
+    const PipelineStageMask wait_stages,
+    const Semaphore*        signal_semaphore,
+    const Fence*            fence)
+{
+    RecordAndSubmit(wait_semaphore, wait_stages, signal_semaphore, nullptr, 0u, fence);
+}
+
+void FrameGraph::Execute(
+    const Semaphore*            wait_semaphore,
+    const PipelineStageMask     wait_stages,
+    const Semaphore*            signal_semaphore,
+    const TimelineSemaphore&    timeline_semaphore,
+    const std::uint64_t         timeline_value)
+{
+    RecordAndSubmit(wait_semaphore, wait_stages, signal_semaphore, &timeline_semaphore, timeline_value, nullptr);
+}
+
+void FrameGraph::RecordAndSubmit(
+    const Semaphore*            wait_semaphore,
+    const PipelineStageMask     wait_stages,
+    const Semaphore*            signal_semaphore,
+    const TimelineSemaphore*    timeline_semaphore,
+    const std::uint64_t         timeline_value,
+    const Fence*                fence)
+{
+    assert(compiled);
+    if (submissions.empty())
+    {
+        // Keep the semaphore and fence protocol of the caller working.
+        SubmitBatch batch(device.GetQueue(GraphicsQueue));
+        if (wait_semaphore != nullptr)
+            batch.Wait(*wait_semaphore, wait_stages);
+        if (signal_semaphore != nullptr)
+            batch.Signal(*signal_semaphore);
+        if (timeline_semaphore != nullptr)
+            batch.Signal(*timeline_semaphore, timeline_value);
+        batch.Submit(fence);
+        return;
+    }
+
+    const std::size_t wait_submission = (external_wait_submission != None) ? external_wait_submission : 0u;
+
+    for (std::size_t submission_index = 0u; submission_index != submissions.size(); ++submission_index)
+    {
+        const Submission& submission = submissions[submission_index];
+        CommandBuffer& command_buffer = command_buffers[submission_index];
+        if (command_buffer.GetStatus() != CommandBuffer::Initial)
+            command_buffer.Reset();
+
+        {
+            CommandRecorder recorder(command_buffer);
+            for (const InitialState& initial_state : submission.initial_states)
+            {
+                const Resource& resource = resources[initial_state.resource];
+                if (resource.is_image)
+                    recorder.TrackImage(resource.vk_image, initial_state.layout, initial_state.access, initial_state.stages);
+                else
+                    recorder.TrackBuffer(resource.vk_buffer, initial_state.access, initial_state.stages);
+            }
+            for (const OwnershipTransfer& transfer : submission.returned_acquires)
+            {
+                Resource& resource = resources[transfer.resource];
+                if (resource.is_image && RemoveIfPresent(resource.returned_images, resource.vk_image))
+                {
+                    recorder.AcquireOwnership(resource.vk_image, transfer.source_queue, transfer.layout, transfer.access, transfer.stages);
+                }
+                else if (!resource.is_image && RemoveIfPresent(resource.returned_buffers, resource.vk_buffer))
+                {
+                    recorder.AcquireOwnership(resource.vk_buffer, transfer.source_queue, transfer.access, transfer.stages);
+                }
+            }
+            for (const OwnershipTransfer& transfer : submission.acquires)
+            {
+                const Resource& resource = resources[transfer.resource];
+                if (resource.is_image)
+                    recorder.AcquireOwnership(resource.vk_image, transfer.source_queue, transfer.layout, transfer.access, transfer.stages);
+                else
+                    recorder.AcquireOwnership(resource.vk_buffer, transfer.source_queue, transfer.access, transfer.stages);
+            }
+            // Layout transitions of the first passes must not share a vkCmdPipelineBarrier with the acquires.
+            recorder.FlushBarriers();
+
+            for (const std::size_t pass_index : submission.passes)
+            {
+                const Pass& pass = passes[pass_index];
+                for (const ResourceUse& use : pass.uses)
+                {
+                    const Resource& resource = resources[use.resource];
+                    if (resource.is_image)
+                        recorder.RequireImageState(resource.vk_image, use.layout, use.access, use.stages);
+                    else
+                        recorder.RequireBufferState(resource.vk_buffer, use.access, use.stages);
+                }
+                recorder.FlushBarriers();
+                pass.execute(recorder, *this);
+            }
+
+            // An image released afterwards keeps the stages of its final transition for the release to wait on.
+            for (const ResourceHandle image : submission.leaving_images)
+            {
+                const bool is_released = std::any_of(submission.releases.cbegin(), submission.releases.cend(),
+                    [image](const OwnershipTransfer& transfer)
+                {
+                    return transfer.resource == image;
+                });
+                recorder.RequireImageState(
+                    resources[image].vk_image,
+                    resources[image].final_layout,
+                    0u,
+                    is_released ? AllCommandsStage : BottomOfPipeStage);
+            }
+
+            // Releases of the same image cannot share a vkCmdPipelineBarrier with its final transition.
+            if (!submission.releases.empty())
+                recorder.FlushBarriers();
+            for (const OwnershipTransfer& transfer : submission.releases)
+            {
+                Resource& resource = resources[transfer.resource];
+                if (resource.is_image)
+                    recorder.ReleaseOwnership(resource.vk_image, transfer.destination_queue);
+                else
+                    recorder.ReleaseOwnership(resource.vk_buffer, transfer.destination_queue);
+
+                if (transfer.is_return && resource.is_image)
+                    PushBackUnique(resource.returned_images, resource.vk_image);
+                else if (transfer.is_return)
+                    PushBackUnique(resource.returned_buffers, resource.vk_buffer);
+            }
+        }
+
+        SubmitBatch batch(device.GetQueue(submission.queue_type));
+        batch.Add(command_buffer);
+        if (wait_semaphore != nullptr && submission_index == wait_submission)
+            batch.Wait(*wait_semaphore, wait_stages);
+        for (const SubmissionDependency& dependency : dependencies)
+        {
+            if (dependency.consumer == submission_index)
+                batch.Wait(*dependency.semaphore, dependency.wait_stages);
+            if (dependency.producer == submission_index)
+                batch.Signal(*dependency.semaphore);
+        }
+        const bool is_last_submission = submission_index + 1u == submissions.size();
+        if (is_last_submission && signal_semaphore != nullptr)
+            batch.Signal(*signal_semaphore);
+        if (is_last_submission && timeline_semaphore != nullptr)
+            batch.Signal(*timeline_semaphore, timeline_value);
+        batch.Submit(is_last_submission ? fence : nullptr);
+    }
+}
+
+VkImage FrameGraph::GetImage(const ResourceHandle image) const
+{
+    assert(resources[image].is_image);
+    return resources[image].vk_image;
+}
+
+VkImageView FrameGraph::GetImageView(const ResourceHandle image) const
+{
+    assert(resources[image].is_image && !resources[image].is_imported);
+    return resources[image].vk_image_view;
+}
+
+VkBuffer FrameGraph::GetBuffer(const ResourceHandle buffer) const
+{
+    assert(!resources[buffer].is_image);
+    return resources[buffer].vk_buffer;
+}
+
+std::vector<std::string> FrameGraph::GetScheduledPasses() const
+{
+    std::vector<std::string> names;
+    for (const Submission& submission : submissions)
+    {
+        for (const std::size_t pass_index : submission.passes)
+        {
+            names.push_back(passes[pass_index].name);
+        }
+    }
+    return names;
+}
+
+std::size_t FrameGraph::GetSubmissionCount() const
+{
+    return submissions.size();
+}
+
+VkDeviceSize FrameGraph::GetTransientMemorySize() const
+{
+    VkDeviceSize size = 0u;
+    for (const MemoryAllocation& allocation : memory_slots)
+    {
+        size += allocation.size;
+    }
+    return size;
+}
+
+VkDeviceSize FrameGraph::GetUnaliasedTransientMemorySize() const
+{
+    return unaliased_memory_size;
+}
+
+QueueType FrameGraph::ResolveQueueType(const QueueType queue_type) const
+{
+    // Queue types that fall back to one VkQueue are scheduled as one, so their passes share submissions.
+    for (const QueueType candidate : { GraphicsQueue, ComputeQueue, TransferQueue })
+    {
+        if (device.Supports(candidate) && device.SharesQueue(candidate, queue_type))
+            return candidate;
+    }
+    return queue_type;
+}
+
+std::vector<std::size_t> FrameGraph::CullPasses() const
+{
+    // Walking backwards, a pass is needed if it has side effects or writes what a needed pass reads.
+    std::vector<bool> is_read_later(resources.size(), false);
+    std::vector<std::size_t> kept_passes;
+    for (std::size_t pass_index = passes.size(); pass_index-- != 0u;)
+    {
+        const Pass& pass = passes[pass_index];
+        bool is_needed = pass.never_culled;
+        for (const ResourceUse& use : pass.uses)
+        {
+            if (use.is_write && (resources[use.resource].is_imported || is_read_later[use.resource]))
+                is_needed = true;
+        }
+        if (!is_needed)
+            continue;
+
+        for (const ResourceUse& use : pass.uses)
+        {
+            if (!use.is_write)
+                is_read_later[use.resource] = true;
+        }
+        kept_passes.push_back(pass_index);
+    }
+    std::reverse(kept_passes.begin(), kept_passes.end());
+    return kept_passes;
+}
+
+std::vector<std::size_t> FrameGraph::SchedulePasses(const std::vector<std::size_t>& kept_passes) const
+{
+    // A pass depends on the earlier passes it conflicts with: a read on the last write, a write on the
+    // last write and every read since. Layout transitions count as writes.
+    const std::size_t pass_count = kept_passes.size();
+    std::vector<std::vector<std::size_t>> dependents(pass_count);
+    std::vector<std::size_t> dependency_counts(pass_count, 0u);
+    std::vector<std::size_t> last_writers(resources.size(), None);
+    std::vector<std::vector<std::size_t>> readers(resources.size());
+    std::vector<ImageLayout> layouts(resources.size(), ImageLayout::Undefined);
+
+    auto add_dependency = [&dependents, &dependency_counts](const std::size_t from, const std::size_t to)
+    {
+        if (from == None || from == to)
+            return;
+        if (std::find(dependents[from].cbegin(), dependents[from].cend(), to) == dependents[from].cend())
+        {
+            dependents[from].push_back(to);
+            ++dependency_counts[to];
+        }
+    };
+
+    for (std::size_t i = 0u; i != pass_count; ++i)
+    {
+        for (const ResourceUse& use : passes[kept_passes[i]].uses)
+        {
+            const bool changes_layout = resources[use.resource].is_image && layouts[use.resource] != use.layout;
+            add_dependency(last_writers[use.resource], i);
+            if (use.is_write || changes_layout)
+            {
+                for (const std::size_t reader : readers[use.resource])
+                {
+                    add_dependency(reader, i);
+                }
+                readers[use.resource].clear();
+                last_writers[use.resource] = i;
+            }
+            else
+            {
+                readers[use.resource].push_back(i);
+            }
+            layouts[use.resource] = use.layout;
+        }
+    }
+
+    // Among the ready passes take the first declared one, preferring the queue of the previous pass
+    // so that fewer submissions and semaphores are needed. Declaration order is always a valid order.
+    std::vector<std::size_t> schedule;
+    schedule.reserve(pass_count);
+    std::vector<bool> is_scheduled(pass_count, false);
+    QueueType current_queue_type = GraphicsQueue;
+    while (schedule.size() != pass_count)
+    {
+        std::size_t next = None;
+        for (std::size_t i = 0u; i != pass_count; ++i)
+        {
+            if (is_scheduled[i] || dependency_counts[i] != 0u)
+                continue;
+            if (next == None)
+                next = i;
+            if (!schedule.empty() && ResolveQueueType(passes[kept_passes[i]].queue_type) == current_queue_type)
+            {
+                next = i;
+                break;
+            }
+        }
+        assert(next != None);
+
+        is_scheduled[next] = true;
+        for (const std::size_t dependent : dependents[next])
+        {
+            --dependency_counts[dependent];
+        }
+        current_queue_type = ResolveQueueType(passes[kept_passes[next]].queue_type);
+        schedule.push_back(kept_passes[next]);
+    }
+    return schedule;
+}
+
+void FrameGraph::CreateTransientImages(const std::vector<std::size_t>& schedule)
+{
+    struct Candidate
+    {
+        ResourceHandle          resource;
+        VkMemoryRequirements    memory_requirements;
+    };
+    std::vector<Candidate> candidates;
+
+    for (ResourceHandle handle = 0u; handle != resources.size(); ++handle)
+    {
+        Resource& resource = resources[handle];
+        if (!resource.is_image || resource.is_imported || resource.first_use == None)
+            continue;
+
+        VkImageUsageFlags usage = 0u;
+        for (const std::size_t pass_index : schedule)
+        {
+            for (const ResourceUse& use : passes[pass_index].uses)
+            {
+                if (use.resource == handle)
+                    usage |= GetImageUsage(use.layout);
+            }
+        }
+        if (usage == 0u)
+        {
+            throw Exception("Frame graph image " + resource.name + " has no use that implies an image usage");
+        }
+
+        VkImageCreateInfo image_create_info = {};
+        image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_create_info.imageType = (resource.extent.depth > 1u) ? VK_IMAGE_TYPE_3D : VK_IMAGE_TYPE_2D;
+        image_create_info.format = resource.format;
+        image_create_info.extent = resource.extent;
+        image_create_info.mipLevels = 1u;
+        image_create_info.arrayLayers = 1u;
+        image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_create_info.usage = usage;
+        image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // Images shared between queue families are concurrent rather than transferred back and forth.
+        std::vector<std::uint32_t> queue_family_indices;
+        for (const QueueType queue_type : resource.queue_types)
+        {
+            PushBackUnique(queue_family_indices, device.GetQueueFamilyIndex(queue_type));
+        }
+        if (queue_family_indices.size() > 1u)
+        {
+            image_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            image_create_info.queueFamilyIndexCount = static_cast<std::uint32_t>(queue_family_indices.size());
+            image_create_info.pQueueFamilyIndices = queue_family_indices.data();
+        }
+        else
+        {
+            image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        if (vkCreateImage(device.GetHandle(), &image_create_info, nullptr, &resource.vk_image) != VK_SUCCESS)
+        {
+            throw Exception("Cannot create frame graph image " + resource.name);
+        }
+
+        Candidate candidate;
+        candidate.resource = handle;
+        vkGetImageMemoryRequirements(device.GetHandle(), resource.vk_image, &candidate.memory_requirements);
+        unaliased_memory_size += candidate.memory_requirements.size;
+        candidates.push_back(candidate);
+    }
+
+    // Largest images first, each going to the first memory slot whose occupants are all dead by the
+    // time it is first used. Only images used on a single queue share memory, so that handing the
+    // memory over is ordered by the queue itself.
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+    {
+        return a.memory_requirements.size > b.memory_requirements.size;
+    });
+
+    struct MemorySlot
+    {
+        VkMemoryRequirements        memory_requirements;
+        bool                        is_shared;
+        QueueType                   queue_type;
+        std::vector<ResourceHandle> occupants;
+    };
+    std::vector<MemorySlot> slots;
+
+    for (const Candidate& candidate : candidates)
+    {
+        const Resource& resource = resources[candidate.resource];
+        const bool can_share = resource.queue_types.size() == 1u;
+        auto slot = std::find_if(slots.begin(), slots.end(), [this, &candidate, &resource, can_share](const MemorySlot& slot)
+        {
+            if (!can_share || !slot.is_shared || slot.queue_type != resource.queue_types.front())
+                return false;
+            if ((slot.memory_requirements.memoryTypeBits & candidate.memory_requirements.memoryTypeBits) == 0u)
+                return false;
+            return std::none_of(slot.occupants.cbegin(), slot.occupants.cend(), [this, &resource](const ResourceHandle occupant)
+            {
+                return resources[occupant].first_use <= resource.last_use && resource.first_use <= resources[occupant].last_use;
+            });
+        });
+
+        if (slot == slots.end())
+        {
+            MemorySlot new_slot;
+            new_slot.memory_requirements = candidate.memory_requirements;
+            new_slot.is_shared = can_share;
+            new_slot.queue_type = resource.queue_types.front();
+            new_slot.occupants.push_back(candidate.resource);
+            slots.push_back(std::move(new_slot));
+        }
+        else
+        {
+            slot->memory_requirements.size = std::max(slot->memory_requirements.size, candidate.memory_requirements.size);
+            slot->memory_requirements.alignment = std::max(slot->memory_requirements.alignment, candidate.memory_requirements.alignment);
+            slot->memory_requirements.memoryTypeBits &= candidate.memory_requirements.memoryTypeBits;
+            slot->occupants.push_back(candidate.resource);
+        }
+    }
+
+    memory_slots.reserve(slots.size());
+    for (MemorySlot& slot : slots)
+    {
+        // Each occupant takes the memory over from the previous one.
+        std::sort(slot.occupants.begin(), slot.occupants.end(), [this](const ResourceHandle a, const ResourceHandle b)
+        {
+            return resources[a].first_use < resources[b].first_use;
+        });
+        for (std::size_t i = 1u; i < slot.occupants.size(); ++i)
+        {
+            resources[slot.occupants[i]].alias_predecessor = slot.occupants[i - 1u];
+        }
+
+        memory_slots.push_back(device.GetAllocator().Allocate(
+            slot.memory_requirements,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            MemoryUsage::DeviceOnly,
+            ResourceTiling::Optimal,
+            FrameGraphTag));
+        const MemoryAllocation& allocation = memory_slots.back();
+
+        for (const ResourceHandle occupant : slot.occupants)
+        {
+            Resource& resource = resources[occupant];
+            if (vkBindImageMemory(device.GetHandle(), resource.vk_image, allocation.vk_memory, allocation.offset) != VK_SUCCESS)
+            {
+                throw Exception("Cannot bind frame graph image memory");
+            }
+
+            VkImageViewCreateInfo view_create_info = {};
+            view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_create_info.image = resource.vk_image;
+            view_create_info.viewType = (resource.extent.depth > 1u) ? VK_IMAGE_VIEW_TYPE_3D : VK_IMAGE_VIEW_TYPE_2D;
+            view_create_info.format = resource.format;
+            view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_create_info.subresourceRange.levelCount = 1u;
+            view_create_info.subresourceRange.layerCount = 1u;
+            if (vkCreateImageView(device.GetHandle(), &view_create_info, nullptr, &resource.vk_image_view) != VK_SUCCESS)
+            {
+                throw Exception("Cannot create frame graph image view");
+            }
+        }
+    }
+}
+
+void FrameGraph::PlanSynchronization()
+{
+    // Replays the declared uses the way CommandRecorder will track them, to know what state each
+    // submission starts from and which submissions on other queues it has to wait for.
+    struct TrackedState
+    {
+        ImageLayout                 layout = ImageLayout::Undefined;
+        VkAccessFlags               access = 0u;
+        PipelineStageMask           stages = TopOfPipeStage;
+        std::size_t                 first_submission = None;
+        std::size_t                 last_submission = None;
+        std::size_t                 last_write_submission = None;
+        std::vector<std::size_t>    read_submissions;
+
+        // The first use, which a returned ownership is acquired for.
+        VkAccessFlags               first_access = 0u;
+        PipelineStageMask           first_stages = TopOfPipeStage;
+    };
+    std::vector<TrackedState> states(resources.size());
+
+    for (std::size_t submission_index = 0u; submission_index != submissions.size(); ++submission_index)
+    {
+        Submission& submission = submissions[submission_index];
+        for (const std::size_t pass_index : submission.passes)
+        {
+            for (const ResourceUse& use : passes[pass_index].uses)
+            {
+                const Resource& resource = resources[use.resource];
+                TrackedState& state = states[use.resource];
+
+                if (state.last_submission != submission_index)
+                {
+                    const bool same_queue = state.last_submission != None &&
+                        submissions[state.last_submission].queue_type == submission.queue_type;
+                    if (resource.is_imported)
+                    {
+                        // Only one submission can wait on the caller's semaphore, the others using imported
+                        // resources on other queues wait for that one.
+                        if (external_wait_submission == None)
+                            external_wait_submission = submission_index;
+                        AddDependency(external_wait_submission, submission_index, use.stages);
+                    }
+
+                    if (state.last_submission == None && resource.is_imported)
+                    {
+                        // Earlier work on imported resources is ordered by the caller's semaphore.
+                        state.layout = resource.initial_layout;
+                        state.access = 0u;
+                        state.stages = use.stages;
+                        state.first_access = use.access;
+                        state.first_stages = use.stages;
+                    }
+                    else if (state.last_submission == None && resource.alias_predecessor != None)
+                    {
+                        // The memory is taken over once the previous occupant is done with it.
+                        const TrackedState& predecessor = states[resource.alias_predecessor];
+                        state.access = predecessor.access;
+                        state.stages = predecessor.stages;
+                    }
+                    else if (state.last_submission != None && !same_queue)
+                    {
+                        // Ordered by the semaphore wait on the stages of this use.
+                        state.access = 0u;
+                        state.stages = use.stages;
+
+                        // Transient images are concurrent, imported resources move to the family of this queue.
+                        const QueueType source_queue = submissions[state.last_submission].queue_type;
+                        if (resource.is_imported && !device.SharesQueueFamily(source_queue, submission.queue_type))
+                        {
+                            OwnershipTransfer transfer;
+                            transfer.resource = use.resource;
+                            transfer.source_queue = source_queue;
+                            transfer.destination_queue = submission.queue_type;
+                            transfer.layout = state.layout;
+                            transfer.access = use.access;
+                            transfer.stages = use.stages;
+                            transfer.is_return = false;
+                            submissions[state.last_submission].releases.push_back(transfer);
+                            submission.acquires.push_back(transfer);
+                            AddDependency(state.last_submission, submission_index, use.stages);
+                            state.access = use.access;
+                        }
+                    }
+
+                    if (resource.is_image || same_queue)
+                    {
+                        InitialState initial_state;
+                        initial_state.resource = use.resource;
+                        initial_state.layout = state.layout;
+                        initial_state.access = state.access;
+                        initial_state.stages = state.stages;
+                        submission.initial_states.push_back(initial_state);
+                    }
+                }
+
+                const bool changes_layout = resource.is_image && state.layout != use.layout;
+                AddDependency(state.last_write_submission, submission_index, use.stages);
+                if (use.is_write || changes_layout)
+                {
+                    for (const std::size_t read_submission : state.read_submissions)
+                    {
+                        AddDependency(read_submission, submission_index, use.stages);
+                    }
+                    state.read_submissions.clear();
+                    state.last_write_submission = submission_index;
+                }
+                else
+                {
+                    PushBackUnique(state.read_submissions, submission_index);
+                }
+
+                // Same rule as CommandRecorder::RequireState.
+                const bool has_writes = ((state.access | use.access) & BarrierBatch::WriteAccessMask) != 0u;
+                if (!changes_layout && !has_writes)
+                {
+                    state.access |= use.access;
+                    state.stages |= use.stages;
+                }
+                else
+                {
+                    state.layout = use.layout;
+                    state.access = use.access;
+                    state.stages = use.stages;
+                }
+                if (state.first_submission == None)
+                    state.first_submission = submission_index;
+                state.last_submission = submission_index;
+            }
+        }
+    }
+
+    for (ResourceHandle handle = 0u; handle != resources.size(); ++handle)
+    {
+        const Resource& resource = resources[handle];
+        const TrackedState& state = states[handle];
+        if (!resource.is_imported || state.last_submission == None)
+            continue;
+
+        if (resource.is_image && resource.final_layout != ImageLayout::Undefined)
+        {
+            submissions[state.last_submission].leaving_images.push_back(handle);
+        }
+
+        // Hand the resource back to the family that uses it first in the next execution. Images whose
+        // contents are discarded at the start of the frame do not need to be transferred.
+        const QueueType first_queue = submissions[state.first_submission].queue_type;
+        const QueueType last_queue = submissions[state.last_submission].queue_type;
+        if (device.SharesQueueFamily(last_queue, first_queue) ||
+            (resource.is_image && resource.initial_layout == ImageLayout::Undefined))
+        {
+            continue;
+        }
+        const ImageLayout leaving_layout = (resource.final_layout != ImageLayout::Undefined) ?
+            resource.final_layout :
+            state.layout;
+        if (resource.is_image && leaving_layout != resource.initial_layout)
+        {
+            throw Exception("Imported image " + resource.name + " changes queue families and has to be left in its initial layout");
+        }
+        OwnershipTransfer transfer;
+        transfer.resource = handle;
+        transfer.source_queue = last_queue;
+        transfer.destination_queue = first_queue;
+        transfer.layout = resource.initial_layout;
+        transfer.access = state.first_access;
+        transfer.stages = state.first_stages;
+        transfer.is_return = true;
+        submissions[state.last_submission].releases.push_back(transfer);
+        submissions[state.first_submission].returned_acquires.push_back(transfer);
+    }
+
+    // The fence of the last submission only covers its own queue, so it also waits for whatever the
+    // other queues do last.
+    if (submissions.empty())
+        return;
+    const std::size_t last_submission = submissions.size() - 1u;
+    for (std::size_t submission_index = 0u; submission_index != last_submission; ++submission_index)
+    {
+        const bool has_consumer = std::any_of(dependencies.cbegin(), dependencies.cend(),
+            [submission_index](const SubmissionDependency& dependency)
+        {
+            return dependency.producer == submission_index;
+        });
+        if (!has_consumer)
+            AddDependency(submission_index, last_submission, AllCommandsStage);
+    }
+}
+
+void FrameGraph::AddDependency(const std::size_t producer, const std::size_t consumer, const PipelineStageMask wait_stages)
+{
+    // Submissions on the same queue are ordered by the barriers recorded in them.
+    if (producer == None || producer == consumer || submissions[producer].queue_type == submissions[consumer].queue_type)
+        return;
+
+    auto dependency = std::find_if(dependencies.begin(), dependencies.end(),
+        [producer, consumer](const SubmissionDependency& dependency)
+    {
+        return dependency.producer == producer && dependency.consumer == consumer;
+    });
+    if (dependency != dependencies.end())
+    {
+        dependency->wait_stages |= wait_stages;
+        return;
+    }
+
+    SubmissionDependency new_dependency;
+    new_dependency.producer = producer;
+    new_dependency.consumer = consumer;
+    new_dependency.wait_stages = wait_stages;
+    new_dependency.semaphore = std::make_unique<Semaphore>(device);
+    dependencies.push_back(std::move(new_dependency));
+}
+
+}
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/allocator.h>
+#include <vulkan/command_pool.h>
+#include <vulkan/image.h>
+#include <vulkan/synchronization.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        // Describes a frame as passes that declare the resources they read and write. Compile() culls
+        // passes whose results are never used, orders the rest, groups runs of passes on one queue into
+        // a single submission and creates the transient images, placing images whose lifetimes do not
+        // overlap in the same memory. Execute() records every pass behind the barriers its declared uses
+        // need and submits the groups with semaphores between queues.
+        //
+        // The graph is compiled once and executed every frame. Imported resources can be rebound between
+        // executions, e.g. to the acquired swapchain image. Command buffers are reused, so an execution
+        // must have finished before the next one starts.
+        class FrameGraph
+        {
+        public:
+            using ResourceHandle = std::size_t;
+            using ExecuteFunction = std::function<void(CommandRecorder& recorder, const FrameGraph& graph)>;
+
+            class PassBuilder
+            {
+                friend class FrameGraph;
+
+            public:
+                PassBuilder& ReadImage(
+                    const ResourceHandle    image,
+                    const ImageLayout       layout,
+                    const VkAccessFlags     access,
+                    const PipelineStageMask stages);
+                PassBuilder& WriteImage(
+                    const ResourceHandle    image,
+                    const ImageLayout       layout,
+                    const VkAccessFlags     access,
+                    const PipelineStageMask stages);
+                PassBuilder& ReadBuffer(
+                    const ResourceHandle    buffer,
+                    const VkAccessFlags     access,
+                    const PipelineStageMask stages);
+                PassBuilder& WriteBuffer(
+                    const ResourceHandle    buffer,
+                    const VkAccessFlags     access,
+                    const PipelineStageMask stages);
+
+                // Keeps the pass even if nothing reads what it writes.
+                PassBuilder& NeverCull();
+
+            private:
+                PassBuilder(FrameGraph& graph, const std::size_t pass_index);
+
+                PassBuilder& AddUse(
+                    const ResourceHandle    resource,
+                    const ImageLayout       layout,
+                    const VkAccessFlags     access,
+                    const PipelineStageMask stages,
+                    const bool              is_write);
+
+                FrameGraph&         graph;
+                const std::size_t   pass_index;
+            };
+
+            explicit FrameGraph(const Device& device);
+            FrameGraph(const FrameGraph& other) = delete;
+            ~FrameGraph();
+
+            // Transient images only live within the frame. Their usage flags follow from the declared uses.
+            ResourceHandle CreateImage(const std::string& name, const VkFormat format, const VkExtent3D& extent);
+
+            // Imported resources outlive the frame, so passes writing them are never culled. An imported
+            // image is expected in initial_layout and left in final_layout (unless Undefined) after its last use.
+            // Imported resources are exclusive to one queue family: the graph transfers ownership between the
+            // submissions that use them and hands it back to the family of the first use after the last one,
+            // so an image whose contents are kept has to be left in its initial layout.
+            ResourceHandle ImportImage(
+                const std::string&      name,
+                const VkImage           image,
+                const ImageLayout       initial_layout,
+                const ImageLayout       final_layout);
+            ResourceHandle ImportBuffer(const std::string& name, const VkBuffer buffer);
+            void SetImportedImage(const ResourceHandle image, const VkImage vk_image);
+            void SetImportedBuffer(const ResourceHandle buffer, const VkBuffer vk_buffer);
+
+            PassBuilder AddPass(const std::string& name, const QueueType queue_type, ExecuteFunction execute);
+
+            void Compile();
+
+            // The wait semaphore is waited on by the first submission that uses an imported resource, and every
+            // later submission using one on another queue waits for that submission. The last submission
+            // signals the semaphore and the fence after every other submission has finished.
+            void Execute(
+                const Semaphore*        wait_semaphore = nullptr,
+                const PipelineStageMask wait_stages = AllCommandsStage,
+                const Semaphore*        signal_semaphore = nullptr,
+                const Fence*            fence = nullptr);
+
+            // Same, but the last submission signals timeline_value on the timeline semaphore instead of a fence.
+            void Execute(
+                const Semaphore*            wait_semaphore,
+                const PipelineStageMask     wait_stages,
+                const Semaphore*            signal_semaphore,
+                const TimelineSemaphore&    timeline_semaphore,
+                const std::uint64_t         timeline_value);
+
+            // Resource handles for the passes while they are recorded.
+            VkImage GetImage(const ResourceHandle image) const;
+            VkImageView GetImageView(const ResourceHandle image) const;
+            VkBuffer GetBuffer(const ResourceHandle buffer) const;
+
+            // Names of the passes that survived culling, in execution order.
+            std::vector<std::string> GetScheduledPasses() const;
+            std::size_t GetSubmissionCount() const;
+
+            // Memory taken by the transient images, and what it would be without aliasing.
+            VkDeviceSize GetTransientMemorySize() const;
+            VkDeviceSize GetUnaliasedTransientMemorySize() const;
+
+        private:
+            enum : std::size_t
+            {
+                None = ~std::size_t(0u)
+            };
+
+            struct ResourceUse
+            {
+                ResourceHandle      resource;
+                ImageLayout         layout;
+                VkAccessFlags       access;
+                PipelineStageMask   stages;
+                bool                is_write;
+            };
+
+            struct Pass
+            {
+                std::string                 name;
+                QueueType                   queue_type;
+                ExecuteFunction             execute;
+                std::vector<ResourceUse>    uses;
+                bool                        never_culled = false;
+            };
+
+            struct Resource
+            {
+                std::string         name;
+                bool                is_image = false;
+                bool                is_imported = false;
+                VkImage             vk_image = VK_NULL_HANDLE;
+                VkImageView         vk_image_view = VK_NULL_HANDLE;
+                VkBuffer            vk_buffer = VK_NULL_HANDLE;
+
+                VkFormat            format = VK_FORMAT_UNDEFINED;
+                VkExtent3D          extent = {};
+                ImageLayout         initial_layout = ImageLayout::Undefined;
+                ImageLayout         final_layout = ImageLayout::Undefined;
+
+                // Lifetime in schedule positions and the queues the resource is used on.
+                std::size_t         first_use = None;
+                std::size_t         last_use = None;
+                std::vector<QueueType> queue_types;
+
+                // The previous occupant of the memory of an aliased transient image.
+                std::size_t         alias_predecessor = None;
+
+                // Imported handles whose ownership an execution handed back to the family of the first use.
+                std::vector<VkImage>    returned_images;
+                std::vector<VkBuffer>   returned_buffers;
+            };
+
+            // State of a resource when a submission starts, handed to its CommandRecorder.
+            struct InitialState
+            {
+                ResourceHandle      resource;
+                ImageLayout         layout;
+                VkAccessFlags       access;
+                PipelineStageMask   stages;
+            };
+
+            // Queue family ownership transfer of an imported resource, recorded as a release at the end of
+            // one submission and an acquire before the first pass of another.
+            struct OwnershipTransfer
+            {
+                ResourceHandle      resource;
+                QueueType           source_queue;
+                QueueType           destination_queue;
+                ImageLayout         layout;
+                VkAccessFlags       access;  // Of the first use after the acquire
+                PipelineStageMask   stages;
+                bool                is_return; // Hands the resource back for the next execution
+            };
+
+            struct Submission
+            {
+                QueueType                       queue_type;
+                std::vector<std::size_t>        passes;
+                std::vector<InitialState>       initial_states;
+                std::vector<ResourceHandle>     leaving_images;
+                std::vector<OwnershipTransfer>  acquires;
+                std::vector<OwnershipTransfer>  releases;
+
+                // Ownership handed back by the previous execution, acquired only for the resources that
+                // were actually released.
+                std::vector<OwnershipTransfer>  returned_acquires;
+            };
+
+            struct SubmissionDependency
+            {
+                std::size_t                 producer;
+                std::size_t                 consumer;
+                PipelineStageMask           wait_stages;
+                std::unique_ptr<Semaphore>  semaphore;
+            };
+
+            QueueType ResolveQueueType(const QueueType queue_type) const;
+
+            std::vector<std::size_t> CullPasses() const;
+            std::vector<std::size_t> SchedulePasses(const std::vector<std::size_t>& kept_passes) const;
+            void CreateTransientImages(const std::vector<std::size_t>& schedule);
+            void PlanSynchronization();
+
+            void AddDependency(const std::size_t producer, const std::size_t consumer, const PipelineStageMask wait_stages);
+
+            void RecordAndSubmit(
+                const Semaphore*            wait_semaphore,
+                const PipelineStageMask     wait_stages,
+                const Semaphore*            signal_semaphore,
+                const TimelineSemaphore*    timeline_semaphore,
+                const std::uint64_t         timeline_value,
+                const Fence*                fence);
+
+            const Device&                               device;
+            std::vector<Pass>                           passes;
+            std::vector<Resource>                       resources;
+            bool                                        compiled = false;
+
+            std::vector<Submission>                     submissions;
+            std::vector<SubmissionDependency>           dependencies;
+            std::size_t                                 external_wait_submission = None;
+            std::vector<MemoryAllocation>               memory_slots;
+            VkDeviceSize                                unaliased_memory_size = 0u;
+
+            std::vector<std::unique_ptr<CommandPool>>   command_pools;
+            std::vector<CommandBuffer>                  command_buffers;
+        };
+    }
+}
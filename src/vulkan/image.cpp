@@ -0,0 +1,254 @@
+#include "image.h"
+
+
+#include <algorithm>
+#include <utility>
+
+#include <vulkan/exception.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+Image::Image(
+    const Device&           device,
+    const VkImageType       image_type,
+    const VkImageViewType   view_type,
+    const VkFormat          format,
+    const VkExtent3D&       extent,
+    VkImageUsageFlags       usage,
+    const std::uint32_t     mip_levels,
+    const char*             tag) :
+    device(device),
+    format(format),
+    extent(extent),
+    mip_levels(mip_levels)
+{
+    assert(mip_levels > 0u && mip_levels <= CountMipLevels(extent));
+
+    // Mip levels are generated on the device by blitting each level from the previous one.
+    if (mip_levels > 1u)
+    {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(device.GetPhysicalDevice(), format, &format_properties);
+        const VkFormatFeatureFlags required_features =
+            VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+        if ((format_properties.optimalTilingFeatures & required_features) != required_features)
+        {
+            throw Exception("Image format does not support linear blits required for mip generation");
+        }
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    VkImageCreateInfo image_create_info = {};
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = image_type;
+    image_create_info.format = format;
+    image_create_info.extent = extent;
+    image_create_info.mipLevels = mip_levels;
+    image_create_info.arrayLayers = 1u;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = usage;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(device.GetHandle(), &image_create_info, nullptr, &vk_image) != VK_SUCCESS)
+    {
+        throw Exception("Cannot create image");
+    }
+    auto vk_image_scoped = MakeScoped(vk_image, [vk_device = device.GetHandle()](VkImage& image)
+    {
+        vkDestroyImage(vk_device, image, nullptr);
+    });
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device.GetHandle(), vk_image, &memory_requirements);
+
+    allocation = device.GetAllocator().Allocate(
+        memory_requirements,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        MemoryUsage::DeviceOnly,
+        ResourceTiling::Optimal,
+        tag);
+    if (vkBindImageMemory(device.GetHandle(), vk_image, allocation.vk_memory, allocation.offset) != VK_SUCCESS)
+    {
+        device.GetAllocator().Free(allocation);
+        throw Exception("Cannot bind image memory");
+    }
+
+    VkImageViewCreateInfo view_create_info = {};
+    view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_create_info.image = vk_image;
+    view_create_info.viewType = view_type;
+    view_create_info.format = format;
+    view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_create_info.subresourceRange.levelCount = mip_levels;
+    view_create_info.subresourceRange.layerCount = 1u;
+
+    if (vkCreateImageView(device.GetHandle(), &view_create_info, nullptr, &vk_image_view) != VK_SUCCESS)
+    {
+        device.GetAllocator().Free(allocation);
+        throw Exception("Cannot create image view");
+    }
+
+    vk_image_scoped.Release();
+}
+
+Image::Image(Image&& other) :
+    device(other.device),
+    format(other.format),
+    extent(other.extent),
+    mip_levels(other.mip_levels),
+    layout(other.layout),
+    allocation(other.allocation)
+{
+    std::swap(vk_image, other.vk_image);
+    std::swap(vk_image_view, other.vk_image_view);
+}
+
+Image::~Image()
+{
+    if (vk_image != VK_NULL_HANDLE)
+    {
+        vkDestroyImageView(device.GetHandle(), vk_image_view, nullptr);
+        vkDestroyImage(device.GetHandle(), vk_image, nullptr);
+        device.GetAllocator().Free(allocation);
+    }
+}
+
+std::uint32_t Image::CountMipLevels(const VkExtent3D& extent)
+{
+    std::uint32_t largest_dimension = std::max(std::max(extent.width, extent.height), extent.depth);
+    std::uint32_t levels = 1u;
+    while (largest_dimension > 1u)
+    {
+        largest_dimension >>= 1u;
+        ++levels;
+    }
+    return levels;
+}
+
+VkImage Image::GetImageHandle() const
+{
+    return vk_image;
+}
+
+VkImageView Image::GetViewHandle() const
+{
+    return vk_image_view;
+}
+
+VkFormat Image::GetFormat() const
+{
+    return format;
+}
+
+VkExtent3D Image::GetExtent() const
+{
+    return extent;
+}
+
+VkExtent3D Image::GetMipExtent(const std::uint32_t mip_level) const
+{
+    assert(mip_level < mip_levels);
+    VkExtent3D mip_extent;
+    mip_extent.width = std::max(extent.width >> mip_level, 1u);
+    mip_extent.height = std::max(extent.height >> mip_level, 1u);
+    mip_extent.depth = std::max(extent.depth >> mip_level, 1u);
+    return mip_extent;
+}
+
+std::uint32_t Image::GetMipLevelCount() const
+{
+    return mip_levels;
+}
+
+ImageLayout Image::GetLayout() const
+{
+    return layout;
+}
+
+const MemoryAllocation& Image::GetAllocation() const
+{
+    return allocation;
+}
+
+const Device& Image::GetDevice() const
+{
+    return device;
+}
+
+
+
+Image2D::Image2D(
+    const Device&           device,
+    const VkFormat          format,
+    const std::uint32_t     width,
+    const std::uint32_t     height,
+    const VkImageUsageFlags usage,
+    const std::uint32_t     mip_levels,
+    const char*             tag) :
+    Image(device, VK_IMAGE_TYPE_2D, VK_IMAGE_VIEW_TYPE_2D, format, VkExtent3D{ width, height, 1u }, usage, mip_levels, tag)
+{
+}
+
+
+
+Image3D::Image3D(
+    const Device&           device,
+    const VkFormat          format,
+    const std::uint32_t     width,
+    const std::uint32_t     height,
+    const std::uint32_t     depth,
+    const VkImageUsageFlags usage,
+    const std::uint32_t     mip_levels,
+    const char*             tag) :
+    Image(device, VK_IMAGE_TYPE_3D, VK_IMAGE_VIEW_TYPE_3D, format, VkExtent3D{ width, height, depth }, usage, mip_levels, tag)
+{
+}
+
+
+
+Sampler::Sampler(
+    const Device&               device,
+    const VkFilter              filter,
+    const VkSamplerMipmapMode   mipmap_mode,
+    const VkSamplerAddressMode  address_mode) :
+    device(device)
+{
+    VkSamplerCreateInfo sampler_info = {};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = filter;
+    sampler_info.minFilter = filter;
+    sampler_info.mipmapMode = mipmap_mode;
+    sampler_info.addressModeU = address_mode;
+    sampler_info.addressModeV = address_mode;
+    sampler_info.addressModeW = address_mode;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+    sampler_info.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    if (vkCreateSampler(device.GetHandle(), &sampler_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create sampler");
+    }
+}
+
+Sampler::Sampler(Sampler&& other) :
+    Object<VkSampler>(std::move(other)),
+    device(other.device)
+{
+}
+
+Sampler::~Sampler()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroySampler(device.GetHandle(), handle, nullptr);
+    }
+}
+
+}
+}
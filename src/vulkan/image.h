@@ -0,0 +1,119 @@
+#pragma once
+
+
+#include <vulkan/allocator.h>
+#include <vulkan/device.h>
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        enum class ImageLayout : std::uint32_t
+        {
+            Undefined = VK_IMAGE_LAYOUT_UNDEFINED,
+            General = VK_IMAGE_LAYOUT_GENERAL,
+            ColorAttachment = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            ShaderReadOnly = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            TransferSource = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            TransferDestination = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            Preinitialized = VK_IMAGE_LAYOUT_PREINITIALIZED,
+            PresentSource = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        };
+
+
+        // Device-local optimal-tiling image with a view covering all of its mip levels.
+        // The layout is tracked at record time by the CommandRecorder commands that take an Image,
+        // so it is only meaningful if every transition of the image goes through them.
+        class Image
+        {
+            friend class CommandRecorder;
+
+        public:
+            Image(const Image& other) = delete;
+            Image(Image&& other);
+            ~Image();
+
+            // Number of levels in a full mip chain down to 1x1x1.
+            static std::uint32_t CountMipLevels(const VkExtent3D& extent);
+
+            VkImage GetImageHandle() const;
+            VkImageView GetViewHandle() const;
+            VkFormat GetFormat() const;
+            VkExtent3D GetExtent() const;
+            VkExtent3D GetMipExtent(const std::uint32_t mip_level) const;
+            std::uint32_t GetMipLevelCount() const;
+            ImageLayout GetLayout() const;
+            const MemoryAllocation& GetAllocation() const;
+            const Device& GetDevice() const;
+
+        protected:
+            explicit Image(
+                const Device&           device,
+                const VkImageType       image_type,
+                const VkImageViewType   view_type,
+                const VkFormat          format,
+                const VkExtent3D&       extent,
+                VkImageUsageFlags       usage,
+                const std::uint32_t     mip_levels,
+                const char*             tag);
+
+        private:
+            const Device&       device;
+            const VkFormat      format;
+            const VkExtent3D    extent;
+            const std::uint32_t mip_levels;
+            ImageLayout         layout = ImageLayout::Undefined;
+            MemoryAllocation    allocation;
+            VkImage             vk_image = VK_NULL_HANDLE;
+            VkImageView         vk_image_view = VK_NULL_HANDLE;
+        };
+
+
+        class Image2D : public Image
+        {
+        public:
+            explicit Image2D(
+                const Device&           device,
+                const VkFormat          format,
+                const std::uint32_t     width,
+                const std::uint32_t     height,
+                const VkImageUsageFlags usage,
+                const std::uint32_t     mip_levels = 1u,
+                const char*             tag = nullptr);
+        };
+
+
+        // Volume texture for density, noise and lighting data sampled with trilinear filtering.
+        class Image3D : public Image
+        {
+        public:
+            explicit Image3D(
+                const Device&           device,
+                const VkFormat          format,
+                const std::uint32_t     width,
+                const std::uint32_t     height,
+                const std::uint32_t     depth,
+                const VkImageUsageFlags usage,
+                const std::uint32_t     mip_levels = 1u,
+                const char*             tag = nullptr);
+        };
+
+
+        class Sampler : public Object<VkSampler>
+        {
+        public:
+            explicit Sampler(
+                const Device&               device,
+                const VkFilter              filter = VK_FILTER_LINEAR,
+                const VkSamplerMipmapMode   mipmap_mode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                const VkSamplerAddressMode  address_mode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE);
+            Sampler(Sampler&& other);
+            ~Sampler();
+
+        private:
+            const Device& device;
+        };
+    }
+}
@@ -1,7 +1,15 @@
 #pragma once
 
 
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <utils/align.h>
+#include <vulkan/allocator.h>
 #include <vulkan/device.h>
+#include <vulkan/exception.h>
 #include <vulkan/object.h>
 
 
@@ -15,8 +23,8 @@ namespace ct
         struct HostMemory
         {
             static constexpr VkMemoryPropertyFlags vk_memory_property_flags =
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            static constexpr MemoryUsage usage = MemoryUsage::Upload;
             static constexpr const char* name = "host";
         };
 
@@ -24,14 +32,33 @@ namespace ct
         {
             static constexpr VkMemoryPropertyFlags vk_memory_property_flags =
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            static constexpr MemoryUsage usage = MemoryUsage::DeviceOnly;
             static constexpr const char* name = "device";
         };
 
+        // Device-local when the device exposes host-visible VRAM (ReBAR), plain host memory otherwise.
+        struct DeviceHostMemory
+        {
+            static constexpr VkMemoryPropertyFlags vk_memory_property_flags =
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            static constexpr MemoryUsage usage = MemoryUsage::DeviceWithHostWrite;
+            static constexpr const char* name = "device host-visible";
+        };
+
+        struct ReadbackMemory
+        {
+            static constexpr VkMemoryPropertyFlags vk_memory_property_flags =
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+            static constexpr MemoryUsage usage = MemoryUsage::Readback;
+            static constexpr const char* name = "readback";
+        };
+
         template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
         class Buffer
         {
         public:
-            explicit Buffer(const Device& device, const std::size_t count);
+            // The tag groups the allocation in the memory statistics and must be a string literal.
+            explicit Buffer(const Device& device, const std::size_t count, const char* tag = nullptr);
             ~Buffer();
             Buffer(Buffer<T, MemoryType, UsageFlags>&& other);
             Buffer(const Buffer<T, MemoryType, UsageFlags>& other) = delete;
@@ -42,26 +69,15 @@ namespace ct
 
             VkBuffer GetBufferHandle() const;
             VkDeviceMemory GetMemoryHandle() const;
+            VkDeviceSize GetMemoryOffset() const;
+            const MemoryAllocation& GetAllocation() const;
+            T* GetMappedData() const;
             const Device& GetDevice() const;
 
         private:
-            static std::uint32_t FindSuitableMemoryTypeIndex(
-                const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties,
-                const VkMemoryRequirements&             memory_requirements,
-                const VkMemoryPropertyFlags             requested_memory_properties);
-
-            static bool IsMemorySupportedByDevice(
-                const std::uint32_t             memory_type_index,
-                const VkMemoryRequirements&     memory_requirements);
-
-            static bool DoesMemoryHaveProperties(
-                const VkMemoryType&             memory_type,
-                const VkMemoryPropertyFlags     requested_memory_properties);
-
             const Device&       device;
             const std::size_t   count;
-            std::size_t         allocation_size;
-            VkDeviceMemory      vk_memory = VK_NULL_HANDLE;
+            MemoryAllocation    allocation;
             VkBuffer            vk_buffer = VK_NULL_HANDLE;
         };
 
@@ -76,35 +92,76 @@ namespace ct
         template <typename T>
         using UniformBuffer = Buffer<T, HostMemory, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT>;
 
+        // Written by compute passes and read back as dispatch arguments.
+        template <typename T>
+        using IndirectBuffer = Buffer<T, DeviceMemory, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT>;
 
+        template <typename T>
+        using ReadbackBuffer = Buffer<T, ReadbackMemory, VK_BUFFER_USAGE_TRANSFER_DST_BIT>;
+
+        template <typename T>
+        using DynamicBuffer = Buffer<T, DeviceHostMemory, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT>;
+
+
+        // A typed view into a persistently mapped host-visible buffer. Creating and
+        // destroying views does not involve the driver unless the memory is not coherent:
+        // then the view invalidates its range when it is created over readback memory and
+        // flushes the ranges written through Write() or marked with MarkWritten() when
+        // Flush() is called. Written ranges have to be flushed before the view is destroyed.
         template <typename T>
         class MemoryMap
         {
         public:
-            explicit MemoryMap(const StagingBuffer<T>& buffer);
+            enum : std::size_t
+            {
+                WholeBuffer = ~std::size_t(0u)
+            };
+
+            template <typename MemoryType, VkBufferUsageFlags UsageFlags>
+            explicit MemoryMap(
+                const Buffer<T, MemoryType, UsageFlags>&    buffer,
+                const std::size_t                           offset = 0u,
+                const std::size_t                           count = WholeBuffer);
             explicit MemoryMap(const UniformBuffer<T>& buffer, const Fence& fence);
             MemoryMap(const MemoryMap<T>& other) = delete;
             MemoryMap(MemoryMap<T>&& other);
             ~MemoryMap();
 
-            T& operator[](const std::size_t index) const;
-            T* begin() const;
-            T* end() const;
+            // Writes through references or pointers are not tracked; use Write() or call MarkWritten().
+            T& operator[](const std::size_t index);
+            const T& operator[](const std::size_t index) const;
+            T* begin();
+            T* end();
+            const T* begin() const;
+            const T* end() const;
             std::size_t GetCount() const;
+            std::size_t GetOffset() const;
 
-        private:
-            void Initialize();
+            void Write(const std::size_t index, const T& value);
+            void Write(const std::size_t index, const T* values, const std::size_t write_count);
+            void MarkWritten(const std::size_t index, const std::size_t written_count);
+            void Flush();
+            void Invalidate();
 
-            const Device&           device;
-            const VkDeviceMemory    vk_memory;
+        private:
+            bool FlushWrittenRanges();
 
-            mutable T*          data;
+            const Device*       device;
+            MemoryAllocation    allocation;
+            T*                  data;
+            std::size_t         offset;
             std::size_t         count;
+
+            // Written byte ranges relative to the memory object, aligned to nonCoherentAtomSize.
+            std::vector<std::pair<VkDeviceSize, VkDeviceSize>> written_ranges;
         };
 
 
-        template <typename T>
-        MemoryMap<T> MapMemory(const StagingBuffer<T>& buffer);
+        template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+        MemoryMap<T> MapMemory(
+            const Buffer<T, MemoryType, UsageFlags>&    buffer,
+            const std::size_t                           offset = 0u,
+            const std::size_t                           count = MemoryMap<T>::WholeBuffer);
 
 
         template <typename T>
@@ -117,7 +174,8 @@ namespace ct
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
 ct::vulkan::Buffer<T, MemoryType, UsageFlags>::Buffer(
     const ct::vulkan::Device&   device,
-    const std::size_t           count) :
+    const std::size_t           count,
+    const char*                 tag) :
     device(device),
     count(count)
 {
@@ -139,26 +197,25 @@ ct::vulkan::Buffer<T, MemoryType, UsageFlags>::Buffer(
     VkMemoryRequirements memory_requirements;
     vkGetBufferMemoryRequirements(device.GetHandle(), vk_buffer, &memory_requirements);
 
-    VkPhysicalDeviceMemoryProperties memory_properties;
-    vkGetPhysicalDeviceMemoryProperties(device.GetPhysicalDevice(), &memory_properties);
-
-    const std::uint32_t memory_type_index = FindSuitableMemoryTypeIndex(
-        memory_properties,
-        memory_requirements,
-        MemoryType::vk_memory_property_flags);
-
-    allocation_size = memory_requirements.size;
-
-    VkMemoryAllocateInfo allocate_info = {};
-    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocate_info.allocationSize = memory_requirements.size;
-    allocate_info.memoryTypeIndex = memory_type_index;
-    if (vkAllocateMemory(device.GetHandle(), &allocate_info, nullptr, &vk_memory) != VK_SUCCESS)
+    try
+    {
+        allocation = device.GetAllocator().Allocate(
+            memory_requirements,
+            MemoryType::vk_memory_property_flags,
+            MemoryType::usage,
+            ResourceTiling::Linear,
+            tag);
+    }
+    catch (const Exception& e)
     {
-        throw Exception(std::string("Cannot allocate ") + MemoryType::name + " memory");
+        throw Exception(std::string("Cannot allocate ") + MemoryType::name + " memory: " + e.what());
     }
 
-    vkBindBufferMemory(device.GetHandle(), vk_buffer, vk_memory, 0u);
+    if (vkBindBufferMemory(device.GetHandle(), vk_buffer, allocation.vk_memory, allocation.offset) != VK_SUCCESS)
+    {
+        device.GetAllocator().Free(allocation);
+        throw Exception("Cannot bind buffer memory");
+    }
 
     vk_buffer_scoped.Release();
 }
@@ -168,8 +225,8 @@ inline ct::vulkan::Buffer<T, MemoryType, UsageFlags>::~Buffer()
 {
     if (vk_buffer != VK_NULL_HANDLE)
     {
-        vkFreeMemory(device.GetHandle(), vk_memory, nullptr);
         vkDestroyBuffer(device.GetHandle(), vk_buffer, nullptr);
+        device.GetAllocator().Free(allocation);
     }
 }
 
@@ -178,10 +235,9 @@ inline ct::vulkan::Buffer<T, MemoryType, UsageFlags>::Buffer(
     Buffer<T, MemoryType, UsageFlags>&& other) :
     device(other.device),
     count(other.count),
-    allocation_size(other.allocation_size),
-    vk_memory(other.vk_memory)
+    allocation(other.allocation)
 {
-    swap(vk_buffer, other.vk_buffer);
+    std::swap(vk_buffer, other.vk_buffer);
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
@@ -193,7 +249,7 @@ inline std::size_t ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetCount() con
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
 inline std::size_t ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetAllocationSizeInBytes() const
 {
-    return allocation_size;
+    return allocation.size;
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
@@ -211,101 +267,125 @@ inline VkBuffer ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetBufferHandle()
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
 inline VkDeviceMemory ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetMemoryHandle() const
 {
-    return vk_memory;
+    return allocation.vk_memory;
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
-inline const ct::vulkan::Device& ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetDevice() const
+inline VkDeviceSize ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetMemoryOffset() const
 {
-    return device;
+    return allocation.offset;
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
-inline std::uint32_t ct::vulkan::Buffer<T, MemoryType, UsageFlags>::FindSuitableMemoryTypeIndex(
-    const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties,
-    const VkMemoryRequirements&             memory_requirements,
-    const VkMemoryPropertyFlags             requested_memory_properties)
+inline const ct::vulkan::MemoryAllocation& ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetAllocation() const
 {
-    const std::uint32_t memory_type_count = physical_device_memory_properties.memoryTypeCount;
-    for (std::uint32_t index = 0u; index != memory_type_count; ++index)
-    {
-        const VkMemoryType& memory_type = physical_device_memory_properties.memoryTypes[index];
-        if (IsMemorySupportedByDevice(index, memory_requirements) &&
-            DoesMemoryHaveProperties(memory_type, requested_memory_properties))
-        {
-            return index;
-        }
-    }
-    throw Exception("Cannot find a memory type with requested properties");
+    return allocation;
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
-inline bool ct::vulkan::Buffer<T, MemoryType, UsageFlags>::IsMemorySupportedByDevice(
-    const std::uint32_t             memory_type_index,
-    const VkMemoryRequirements&     memory_requirements)
+inline T* ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetMappedData() const
 {
-    return (memory_requirements.memoryTypeBits & (1 << memory_type_index)) != 0;
+    static_assert((MemoryType::vk_memory_property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0,
+        "Only host-visible buffers can be mapped");
+    assert(allocation.mapped_data != nullptr);
+    return static_cast<T*>(allocation.mapped_data);
 }
 
 template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
-inline bool ct::vulkan::Buffer<T, MemoryType, UsageFlags>::DoesMemoryHaveProperties(
-    const VkMemoryType&             memory_type,
-    const VkMemoryPropertyFlags     requested_memory_properties)
+inline const ct::vulkan::Device& ct::vulkan::Buffer<T, MemoryType, UsageFlags>::GetDevice() const
 {
-    return (memory_type.propertyFlags & requested_memory_properties) == requested_memory_properties;
+    return device;
 }
 
 
 
 template <typename T>
-inline ct::vulkan::MemoryMap<T>::MemoryMap(const StagingBuffer<T>& buffer) :
-    device(buffer.GetDevice()),
-    vk_memory(buffer.GetMemoryHandle()),
-    count(buffer.GetCount())
+template <typename MemoryType, VkBufferUsageFlags UsageFlags>
+inline ct::vulkan::MemoryMap<T>::MemoryMap(
+    const Buffer<T, MemoryType, UsageFlags>&    buffer,
+    const std::size_t                           offset,
+    const std::size_t                           count) :
+    device(&buffer.GetDevice()),
+    allocation(buffer.GetAllocation()),
+    data(buffer.GetMappedData() + offset),
+    offset(offset),
+    count(count == WholeBuffer ? buffer.GetCount() - offset : count)
 {
-    Initialize();
+    assert(offset <= buffer.GetCount());
+    assert(offset + this->count <= buffer.GetCount());
+    if (MemoryType::usage == MemoryUsage::Readback)
+    {
+        Invalidate();
+    }
 }
 
 template<typename T>
 inline ct::vulkan::MemoryMap<T>::MemoryMap(const UniformBuffer<T>& buffer, const Fence& fence) :
-    device(buffer.GetDevice()),
-    vk_memory(buffer.GetMemoryHandle()),
+    device(&buffer.GetDevice()),
+    allocation(buffer.GetAllocation()),
+    data(buffer.GetMappedData()),
+    offset(0u),
     count(buffer.GetCount())
 {
     fence.Wait();
-    Initialize();
 }
 
 template<typename T>
 inline ct::vulkan::MemoryMap<T>::MemoryMap(MemoryMap<T>&& other) :
     device(other.device),
-    vk_memory(other.vk_memory),
+    allocation(other.allocation),
     data(other.data),
-    count(other.count)
+    offset(other.offset),
+    count(other.count),
+    written_ranges(std::move(other.written_ranges))
 {
+    other.data = nullptr;
+    other.count = 0u;
+    other.written_ranges.clear();
 }
 
 template <typename T>
 inline ct::vulkan::MemoryMap<T>::~MemoryMap()
 {
-    vkUnmapMemory(device.GetHandle(), vk_memory);
+    // Destructors cannot report a failed flush, so callers have to Flush() themselves.
+    assert(written_ranges.empty());
+    FlushWrittenRanges();
+}
+
+template <typename T>
+inline T& ct::vulkan::MemoryMap<T>::operator[](const std::size_t index)
+{
+    assert(index < count);
+    return data[index];
 }
 
 template <typename T>
-inline T& ct::vulkan::MemoryMap<T>::operator[](const std::size_t index) const
+inline const T& ct::vulkan::MemoryMap<T>::operator[](const std::size_t index) const
 {
     assert(index < count);
     return data[index];
 }
 
 template <typename T>
-inline T* ct::vulkan::MemoryMap<T>::begin() const
+inline T* ct::vulkan::MemoryMap<T>::begin()
+{
+    return data;
+}
+
+template <typename T>
+inline T* ct::vulkan::MemoryMap<T>::end()
+{
+    return data + count;
+}
+
+template <typename T>
+inline const T* ct::vulkan::MemoryMap<T>::begin() const
 {
     return data;
 }
 
 template <typename T>
-inline T* ct::vulkan::MemoryMap<T>::end() const
+inline const T* ct::vulkan::MemoryMap<T>::end() const
 {
     return data + count;
 }
@@ -316,19 +396,127 @@ inline std::size_t ct::vulkan::MemoryMap<T>::GetCount() const
     return count;
 }
 
-template<typename T>
-inline void ct::vulkan::MemoryMap<T>::Initialize()
+template <typename T>
+inline std::size_t ct::vulkan::MemoryMap<T>::GetOffset() const
 {
-    if (vkMapMemory(device.GetHandle(), vk_memory, 0u, count * sizeof(T), 0u, &static_cast<void*>(data)) != VK_SUCCESS)
+    return offset;
+}
+
+template <typename T>
+inline void ct::vulkan::MemoryMap<T>::Write(const std::size_t index, const T& value)
+{
+    assert(index < count);
+    data[index] = value;
+    MarkWritten(index, 1u);
+}
+
+template <typename T>
+inline void ct::vulkan::MemoryMap<T>::Write(const std::size_t index, const T* values, const std::size_t write_count)
+{
+    assert(index + write_count <= count);
+    std::copy(values, values + write_count, data + index);
+    MarkWritten(index, write_count);
+}
+
+template <typename T>
+inline void ct::vulkan::MemoryMap<T>::MarkWritten(const std::size_t index, const std::size_t written_count)
+{
+    if (allocation.IsHostCoherent() || written_count == 0u)
+        return;
+
+    assert(index + written_count <= count);
+    const VkDeviceSize atom_size = device->GetProperties().limits.nonCoherentAtomSize;
+    const VkDeviceSize first_byte = allocation.offset + (offset + index) * sizeof(T);
+    const VkDeviceSize range_begin = utils::AlignDown(first_byte, atom_size);
+    const VkDeviceSize range_end = std::min(
+        utils::AlignUp(first_byte + written_count * sizeof(T), atom_size),
+        allocation.offset + allocation.size);
+
+    // Sequential writes keep extending the last range.
+    if (!written_ranges.empty() &&
+        range_begin <= written_ranges.back().second &&
+        range_end >= written_ranges.back().first)
     {
-        throw Exception("Failed to map host buffer memory");
+        written_ranges.back().first = std::min(written_ranges.back().first, range_begin);
+        written_ranges.back().second = std::max(written_ranges.back().second, range_end);
+    }
+    else
+    {
+        written_ranges.emplace_back(range_begin, range_end);
+    }
+}
+
+template <typename T>
+inline void ct::vulkan::MemoryMap<T>::Flush()
+{
+    if (!FlushWrittenRanges())
+    {
+        throw Exception("Failed to flush mapped memory ranges");
+    }
+}
+
+template <typename T>
+inline void ct::vulkan::MemoryMap<T>::Invalidate()
+{
+    if (allocation.IsHostCoherent() || count == 0u)
+        return;
+
+    const VkDeviceSize atom_size = device->GetProperties().limits.nonCoherentAtomSize;
+    const VkDeviceSize first_byte = allocation.offset + offset * sizeof(T);
+
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.vk_memory;
+    range.offset = utils::AlignDown(first_byte, atom_size);
+    range.size = std::min(
+        utils::AlignUp(first_byte + count * sizeof(T), atom_size),
+        allocation.offset + allocation.size) - range.offset;
+    if (vkInvalidateMappedMemoryRanges(device->GetHandle(), 1u, &range) != VK_SUCCESS)
+    {
+        throw Exception("Failed to invalidate mapped memory ranges");
     }
 }
 
 template <typename T>
-inline ct::vulkan::MemoryMap<T> ct::vulkan::MapMemory(const StagingBuffer<T>& buffer)
+inline bool ct::vulkan::MemoryMap<T>::FlushWrittenRanges()
+{
+    if (written_ranges.empty())
+        return true;
+
+    std::sort(written_ranges.begin(), written_ranges.end());
+
+    std::vector<VkMappedMemoryRange> ranges;
+    ranges.reserve(written_ranges.size());
+    for (const auto& written_range : written_ranges)
+    {
+        if (!ranges.empty() && written_range.first <= ranges.back().offset + ranges.back().size)
+        {
+            const VkDeviceSize range_end = std::max(ranges.back().offset + ranges.back().size, written_range.second);
+            ranges.back().size = range_end - ranges.back().offset;
+            continue;
+        }
+        VkMappedMemoryRange range = {};
+        range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        range.memory = allocation.vk_memory;
+        range.offset = written_range.first;
+        range.size = written_range.second - written_range.first;
+        ranges.push_back(range);
+    }
+    written_ranges.clear();
+
+    return vkFlushMappedMemoryRanges(
+        device->GetHandle(),
+        static_cast<std::uint32_t>(ranges.size()),
+        ranges.data()) == VK_SUCCESS;
+}
+
+template <typename T, typename MemoryType, VkBufferUsageFlags UsageFlags>
+inline ct::vulkan::MemoryMap<T> ct::vulkan::MapMemory(
+    const Buffer<T, MemoryType, UsageFlags>&    buffer,
+    const std::size_t                           offset,
+    const std::size_t                           count)
 {
-    return MemoryMap<T>(buffer);
+    return MemoryMap<T>(buffer, offset, count);
 }
 
 template<typename T>
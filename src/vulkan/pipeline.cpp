@@ -0,0 +1,156 @@
+#include "pipeline.h"
+
+
+#include <fstream>
+
+#include <vulkan/descriptor_set.h>
+#include <vulkan/device.h>
+#include <vulkan/exception.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+ShaderModule::ShaderModule(const Device& device, const std::vector<std::uint32_t>& code) :
+    device(device)
+{
+    VkShaderModuleCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    create_info.codeSize = code.size() * sizeof(std::uint32_t);
+    create_info.pCode = code.data();
+    if (vkCreateShaderModule(device.GetHandle(), &create_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create shader module");
+    }
+}
+
+ShaderModule::ShaderModule(ShaderModule&& other) :
+    Object<VkShaderModule>(std::move(other)),
+    device(other.device)
+{
+}
+
+ShaderModule::~ShaderModule()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyShaderModule(device.GetHandle(), handle, nullptr);
+    }
+}
+
+std::vector<std::uint32_t> ShaderModule::ReadSpirv(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        throw Exception("Unable to open shader " + path);
+    }
+    const std::streamsize size = file.tellg();
+    if (size <= 0 || size % sizeof(std::uint32_t) != 0)
+    {
+        throw Exception("Shader " + path + " is not SPIR-V");
+    }
+
+    std::vector<std::uint32_t> code(static_cast<std::size_t>(size) / sizeof(std::uint32_t));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(code.data()), size);
+    return code;
+}
+
+
+PipelineLayout::PipelineLayout(
+    const Device&                               device,
+    const std::vector<const DescriptorSetLayout*>& set_layouts,
+    const std::uint32_t                         push_constant_size) :
+    device(device),
+    push_constant_size(push_constant_size)
+{
+    std::vector<VkDescriptorSetLayout> set_layout_handles;
+    set_layout_handles.reserve(set_layouts.size());
+    for (const DescriptorSetLayout* set_layout : set_layouts)
+    {
+        set_layout_handles.push_back(set_layout->GetHandle());
+    }
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.size = push_constant_size;
+
+    VkPipelineLayoutCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    create_info.setLayoutCount = static_cast<std::uint32_t>(set_layout_handles.size());
+    create_info.pSetLayouts = set_layout_handles.data();
+    create_info.pushConstantRangeCount = (push_constant_size != 0u) ? 1u : 0u;
+    create_info.pPushConstantRanges = &push_constant_range;
+    if (vkCreatePipelineLayout(device.GetHandle(), &create_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create pipeline layout");
+    }
+}
+
+PipelineLayout::PipelineLayout(PipelineLayout&& other) :
+    Object<VkPipelineLayout>(std::move(other)),
+    device(other.device),
+    push_constant_size(other.push_constant_size)
+{
+}
+
+PipelineLayout::~PipelineLayout()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineLayout(device.GetHandle(), handle, nullptr);
+    }
+}
+
+std::uint32_t PipelineLayout::GetPushConstantSize() const
+{
+    return push_constant_size;
+}
+
+
+ComputePipeline::ComputePipeline(
+    const Device&           device,
+    const PipelineLayout&   layout,
+    const ShaderModule&     shader,
+    const char*             entry_point) :
+    device(device),
+    layout(layout)
+{
+    VkComputePipelineCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    create_info.stage.module = shader.GetHandle();
+    create_info.stage.pName = entry_point;
+    create_info.layout = layout.GetHandle();
+    if (vkCreateComputePipelines(device.GetHandle(), device.GetPipelineCache(), 1u, &create_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create compute pipeline");
+    }
+}
+
+ComputePipeline::ComputePipeline(ComputePipeline&& other) :
+    Object<VkPipeline>(std::move(other)),
+    device(other.device),
+    layout(other.layout)
+{
+}
+
+ComputePipeline::~ComputePipeline()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyPipeline(device.GetHandle(), handle, nullptr);
+    }
+}
+
+const PipelineLayout& ComputePipeline::GetLayout() const
+{
+    return layout;
+}
+
+}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        class DescriptorSetLayout;
+        class Device;
+
+
+        class ShaderModule : public Object<VkShaderModule>
+        {
+        public:
+            // SPIR-V words, e.g. compiled with glslangValidator -V.
+            explicit ShaderModule(const Device& device, const std::vector<std::uint32_t>& code);
+            ShaderModule(ShaderModule&& other);
+            ~ShaderModule();
+
+            static std::vector<std::uint32_t> ReadSpirv(const std::string& path);
+
+        private:
+            const Device& device;
+        };
+
+
+        // Push constants are visible to the compute stage only.
+        class PipelineLayout : public Object<VkPipelineLayout>
+        {
+        public:
+            explicit PipelineLayout(
+                const Device&                               device,
+                const std::vector<const DescriptorSetLayout*>& set_layouts,
+                const std::uint32_t                         push_constant_size = 0u);
+            PipelineLayout(PipelineLayout&& other);
+            ~PipelineLayout();
+
+            std::uint32_t GetPushConstantSize() const;
+
+        private:
+            const Device&   device;
+            std::uint32_t   push_constant_size;
+        };
+
+
+        class ComputePipeline : public Object<VkPipeline>
+        {
+        public:
+            // The layout has to outlive the pipeline.
+            explicit ComputePipeline(
+                const Device&           device,
+                const PipelineLayout&   layout,
+                const ShaderModule&     shader,
+                const char*             entry_point = "main");
+            ComputePipeline(ComputePipeline&& other);
+            ~ComputePipeline();
+
+            const PipelineLayout& GetLayout() const;
+
+        private:
+            const Device&           device;
+            const PipelineLayout&   layout;
+        };
+    }
+}
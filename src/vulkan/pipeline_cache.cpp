@@ -0,0 +1,273 @@
+#include "pipeline_cache.h"
+
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <vulkan/exception.h>
+
+
+namespace
+{
+    const char FileMagic[4] = { 'C', 'T', 'P', 'C' };
+
+    // The header vkGetPipelineCacheData puts in front of the driver's own data.
+    struct PipelineCacheHeaderVersionOne
+    {
+        std::uint32_t   header_size;
+        std::uint32_t   header_version;
+        std::uint32_t   vendor_id;
+        std::uint32_t   device_id;
+        std::uint8_t    pipeline_cache_uuid[VK_UUID_SIZE];
+    };
+
+    // FNV-1a, enough to notice a truncated or damaged file.
+    std::uint64_t Checksum(const std::vector<std::uint8_t>& data)
+    {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const std::uint8_t byte : data)
+        {
+            hash ^= byte;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    long GetProcessIdentifier()
+    {
+#ifdef _WIN32
+        return static_cast<long>(_getpid());
+#else
+        return static_cast<long>(getpid());
+#endif
+    }
+
+    // Replaces the target in one step, so it is never missing; std::rename fails on Windows while it exists.
+    bool ReplaceExistingFile(const std::string& source, const std::string& target)
+    {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+    }
+
+    // Whether anything follows the header, which a cache without pipelines still returns.
+    bool HasPipelineData(const std::vector<std::uint8_t>& data)
+    {
+        PipelineCacheHeaderVersionOne header = {};
+        std::memcpy(&header, data.data(), sizeof(header));
+        return data.size() > header.header_size;
+    }
+
+    std::vector<std::uint8_t> GetPipelineCacheData(const VkDevice device, const VkPipelineCache pipeline_cache)
+    {
+        std::vector<std::uint8_t> data;
+        std::size_t size = 0u;
+        VkResult result = VK_INCOMPLETE;
+        // The cache may grow between the two calls if other threads create pipelines meanwhile.
+        while (result == VK_INCOMPLETE)
+        {
+            if (vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr) != VK_SUCCESS)
+                return {};
+            data.resize(size);
+            result = vkGetPipelineCacheData(device, pipeline_cache, &size, data.data());
+        }
+        if (result != VK_SUCCESS)
+            return {};
+        data.resize(size);
+        return data;
+    }
+}
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+PipelineCache::PipelineCache(const VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path) :
+    device(device),
+    properties(properties),
+    path(path)
+{
+    const std::vector<std::uint8_t> initial_data = ReadFile();
+
+    VkPipelineCacheCreateInfo create_info = {};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = initial_data.size();
+    create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+    VkResult result = vkCreatePipelineCache(device, &create_info, nullptr, &handle);
+    if (result != VK_SUCCESS && !initial_data.empty())
+    {
+        // The header matched, but the driver still refused the data; start over rather than fail.
+        create_info.initialDataSize = 0u;
+        create_info.pInitialData = nullptr;
+        result = vkCreatePipelineCache(device, &create_info, nullptr, &handle);
+    }
+    if (result != VK_SUCCESS)
+    {
+        throw Exception("Failed to create pipeline cache");
+    }
+    is_warm = create_info.initialDataSize != 0u;
+}
+
+PipelineCache::~PipelineCache()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroyPipelineCache(device, handle, nullptr);
+    }
+}
+
+bool PipelineCache::Save()
+{
+    if (path.empty())
+        return true;
+
+    // Pipelines another process built since startup would otherwise be dropped from the file.
+    const std::vector<std::uint8_t> saved_data = ReadFile();
+    if (!saved_data.empty())
+    {
+        VkPipelineCacheCreateInfo create_info = {};
+        create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        create_info.initialDataSize = saved_data.size();
+        create_info.pInitialData = saved_data.data();
+        VkPipelineCache saved_cache = VK_NULL_HANDLE;
+        if (vkCreatePipelineCache(device, &create_info, nullptr, &saved_cache) == VK_SUCCESS)
+        {
+            vkMergePipelineCaches(device, handle, 1u, &saved_cache);
+            vkDestroyPipelineCache(device, saved_cache, nullptr);
+        }
+    }
+
+    const std::vector<std::uint8_t> data = GetPipelineCacheData(device, handle);
+    if (!IsValidData(data))
+        return false;
+    if (!HasPipelineData(data))
+        return true;
+    return WriteFile(data);
+}
+
+bool PipelineCache::IsWarm() const
+{
+    return is_warm;
+}
+
+const std::string& PipelineCache::GetPath() const
+{
+    return path;
+}
+
+PipelineCache::FileHeader PipelineCache::MakeHeader(const std::vector<std::uint8_t>& data) const
+{
+    FileHeader header = {};
+    std::memcpy(header.magic, FileMagic, sizeof(header.magic));
+    header.file_version = FileVersion;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    std::memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data.size();
+    header.checksum = Checksum(data);
+    return header;
+}
+
+std::vector<std::uint8_t> PipelineCache::ReadFile() const
+{
+    if (path.empty())
+        return {};
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return {};
+
+    FileHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+        return {};
+    // A driver update keeps vendor and device but may change the meaning of the data.
+    const FileHeader expected_header = MakeHeader({});
+    if (std::memcmp(header.magic, expected_header.magic, sizeof(header.magic)) != 0 ||
+        header.file_version != expected_header.file_version ||
+        header.vendor_id != expected_header.vendor_id ||
+        header.device_id != expected_header.device_id ||
+        header.driver_version != expected_header.driver_version ||
+        std::memcmp(header.pipeline_cache_uuid, expected_header.pipeline_cache_uuid, VK_UUID_SIZE) != 0)
+    {
+        return {};
+    }
+
+    file.seekg(0, std::ios::end);
+    const std::streamoff file_size = file.tellg();
+    if (file_size < 0 || static_cast<std::uint64_t>(file_size) != sizeof(header) + header.data_size)
+        return {};
+
+    std::vector<std::uint8_t> data(static_cast<std::size_t>(header.data_size));
+    file.seekg(sizeof(header));
+    if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size())))
+        return {};
+    if (Checksum(data) != header.checksum || !IsValidData(data))
+        return {};
+    return data;
+}
+
+bool PipelineCache::WriteFile(const std::vector<std::uint8_t>& data) const
+{
+    // Unique per process and save, so concurrent writers never share a temporary file.
+    const std::string temporary_path = path + "." + std::to_string(GetProcessIdentifier()) + "." +
+        std::to_string(std::chrono::high_resolution_clock::now().time_since_epoch().count()) + ".tmp";
+    {
+        std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        const FileHeader header = MakeHeader(data);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        file.close();
+        if (!file)
+        {
+            std::remove(temporary_path.c_str());
+            return false;
+        }
+    }
+
+    if (!ReplaceExistingFile(temporary_path, path))
+    {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool PipelineCache::IsValidData(const std::vector<std::uint8_t>& data) const
+{
+    PipelineCacheHeaderVersionOne header = {};
+    if (data.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    return
+        header.header_size >= sizeof(header) &&
+        header.header_size <= data.size() &&
+        header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendor_id == properties.vendorID &&
+        header.device_id == properties.deviceID &&
+        std::memcmp(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+}
+}
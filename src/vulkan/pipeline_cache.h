@@ -0,0 +1,67 @@
+#pragma once
+
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <vulkan/object.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        // A VkPipelineCache that survives restarts. The file starts with a header naming the file format
+        // version, the device and driver that produced the data, its size and checksum; a file written
+        // for anything else, or a damaged one, is ignored rather than handed to the driver.
+        //
+        // Several processes may share the file: Save() merges whatever was saved in the meantime and
+        // replaces the file with a rename, so readers never see a partially written cache.
+        class PipelineCache : public Object<VkPipelineCache>
+        {
+        public:
+            // An empty path keeps the cache in memory only.
+            PipelineCache(const VkDevice device, const VkPhysicalDeviceProperties& properties, const std::string& path);
+            PipelineCache(const PipelineCache& other) = delete;
+            ~PipelineCache();
+
+            // Returns false if the file could not be written; the previous file is then left untouched.
+            // A cache without any pipelines is not written.
+            bool Save();
+
+            // Whether valid data was found in the file at startup.
+            bool IsWarm() const;
+            const std::string& GetPath() const;
+
+            enum : std::uint32_t
+            {
+                FileVersion = 1u
+            };
+
+        private:
+            struct FileHeader
+            {
+                char            magic[4];
+                std::uint32_t   file_version;
+                std::uint32_t   vendor_id;
+                std::uint32_t   device_id;
+                std::uint32_t   driver_version;
+                std::uint8_t    pipeline_cache_uuid[VK_UUID_SIZE];
+                std::uint64_t   data_size;
+                std::uint64_t   checksum;
+            };
+
+            FileHeader MakeHeader(const std::vector<std::uint8_t>& data) const;
+            // The cache data of the file, or nothing if the file is missing or not valid for this device.
+            std::vector<std::uint8_t> ReadFile() const;
+            bool WriteFile(const std::vector<std::uint8_t>& data) const;
+            bool IsValidData(const std::vector<std::uint8_t>& data) const;
+
+            const VkDevice                      device;
+            const VkPhysicalDeviceProperties    properties;
+            const std::string                   path;
+            bool                                is_warm = false;
+        };
+    }
+}
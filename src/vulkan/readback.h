@@ -0,0 +1,158 @@
+#pragma once
+
+
+#include <cassert>
+#include <vector>
+
+#include <vulkan/device.h>
+#include <vulkan/memory.h>
+#include <vulkan/synchronization.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        // Double-buffered GPU-to-host copies. While the host consumes the copy of frame N
+        // the device can already write the copy of frame N+1 into the other slot.
+        //
+        // Per frame: record a copy into GetTarget(), submit it with GetTargetFence() and
+        // call Submitted(). Later, poll IsReady() or block in Wait(), read the oldest
+        // completed copy through Map() and hand the slot back with Release().
+        template <typename T>
+        class Readback
+        {
+        public:
+            enum : std::size_t
+            {
+                SlotCount = 2u
+            };
+
+            // The tag groups the allocations in the memory statistics and must be a string literal.
+            explicit Readback(const Device& device, const std::size_t count, const char* tag = nullptr);
+            Readback(const Readback<T>& other) = delete;
+
+            // If the target slot still holds a copy that has not been released,
+            // that copy is waited for and dropped.
+            ReadbackBuffer<T>& GetTarget();
+            const Fence& GetTargetFence();
+            void Submitted();
+
+            bool HasPending() const;
+            bool IsReady() const;
+            void Wait() const;
+            MemoryMap<T> Map() const;
+            void Release();
+
+            std::size_t GetDroppedCount() const;
+
+        private:
+            struct Slot
+            {
+                Slot(const Device& device, const std::size_t count, const char* tag) :
+                    buffer(device, count, tag),
+                    fence(device)
+                {}
+
+                ReadbackBuffer<T>   buffer;
+                Fence               fence;
+                bool                pending = false;
+            };
+
+            Slot& GetOldestPendingSlot() const;
+
+            mutable std::vector<Slot>   slots;
+            std::size_t                 target_index = 0u;
+            std::size_t                 oldest_index = 0u;
+            std::size_t                 dropped_count = 0u;
+        };
+    }
+}
+
+
+
+template <typename T>
+inline ct::vulkan::Readback<T>::Readback(const Device& device, const std::size_t count, const char* tag)
+{
+    slots.reserve(SlotCount);
+    for (std::size_t i = 0u; i != SlotCount; ++i)
+    {
+        slots.emplace_back(device, count, tag);
+    }
+}
+
+template <typename T>
+inline ct::vulkan::ReadbackBuffer<T>& ct::vulkan::Readback<T>::GetTarget()
+{
+    Slot& slot = slots[target_index];
+    if (slot.pending)
+    {
+        slot.fence.Wait();
+        slot.pending = false;
+        oldest_index = (target_index + 1u) % SlotCount;
+        ++dropped_count;
+    }
+    return slot.buffer;
+}
+
+template <typename T>
+inline const ct::vulkan::Fence& ct::vulkan::Readback<T>::GetTargetFence()
+{
+    Slot& slot = slots[target_index];
+    assert(!slot.pending);
+    slot.fence.Reset();
+    return slot.fence;
+}
+
+template <typename T>
+inline void ct::vulkan::Readback<T>::Submitted()
+{
+    assert(!slots[target_index].pending);
+    slots[target_index].pending = true;
+    target_index = (target_index + 1u) % SlotCount;
+}
+
+template <typename T>
+inline bool ct::vulkan::Readback<T>::HasPending() const
+{
+    return slots[oldest_index].pending;
+}
+
+template <typename T>
+inline bool ct::vulkan::Readback<T>::IsReady() const
+{
+    return HasPending() && slots[oldest_index].fence.IsSignaled();
+}
+
+template <typename T>
+inline void ct::vulkan::Readback<T>::Wait() const
+{
+    GetOldestPendingSlot().fence.Wait();
+}
+
+template <typename T>
+inline ct::vulkan::MemoryMap<T> ct::vulkan::Readback<T>::Map() const
+{
+    assert(IsReady());
+    return MapMemory(GetOldestPendingSlot().buffer);
+}
+
+template <typename T>
+inline void ct::vulkan::Readback<T>::Release()
+{
+    GetOldestPendingSlot().pending = false;
+    oldest_index = (oldest_index + 1u) % SlotCount;
+}
+
+template <typename T>
+inline std::size_t ct::vulkan::Readback<T>::GetDroppedCount() const
+{
+    return dropped_count;
+}
+
+template <typename T>
+inline typename ct::vulkan::Readback<T>::Slot& ct::vulkan::Readback<T>::GetOldestPendingSlot() const
+{
+    assert(HasPending());
+    return slots[oldest_index];
+}
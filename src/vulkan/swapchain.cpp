@@ -1,6 +1,7 @@
 #include "swapchain.h"
 
 #include <cassert>
+#include <cmath>
 
 #include <vulkan/device.h>
 #include <vulkan/exception.h>
@@ -12,14 +13,79 @@ namespace ct
 namespace vulkan
 {
 
-Swapchain::Swapchain(const Device& device, const std::uint32_t width, const std::uint32_t height) :
-    device(device)
+double SwapchainStatistics::GetAverageAcquireWait() const
+{
+    return (acquire_count == 0u) ? 0.0 : total_acquire_wait / static_cast<double>(acquire_count);
+}
+
+double SwapchainStatistics::GetPresentJitter() const
+{
+    return (present_interval_count < 2u) ? 0.0 : std::sqrt(present_interval_m2 / static_cast<double>(present_interval_count - 1u));
+}
+
+void SwapchainStatistics::WriteJson(std::ostream& stream) const
+{
+    stream
+        << "{\"acquire_count\": " << acquire_count
+        << ", \"average_acquire_wait_seconds\": " << GetAverageAcquireWait()
+        << ", \"max_acquire_wait_seconds\": " << max_acquire_wait
+        << ", \"present_interval_count\": " << present_interval_count
+        << ", \"mean_present_interval_seconds\": " << mean_present_interval
+        << ", \"present_jitter_seconds\": " << GetPresentJitter();
+    // Without a refresh interval there is nothing to tell a late present from an on-time one.
+    if (refresh_interval > 0.0)
+    {
+        stream
+            << ", \"refresh_interval_seconds\": " << refresh_interval
+            << ", \"late_present_count\": " << late_present_count
+            << ", \"missed_refresh_count\": " << missed_refresh_count;
+    }
+    else
+    {
+        stream
+            << ", \"refresh_interval_seconds\": null"
+            << ", \"late_present_count\": null"
+            << ", \"missed_refresh_count\": null";
+    }
+    stream << "}";
+}
+
+
+const char* GetPresentModeName(const VkPresentModeKHR present_mode)
+{
+    switch (present_mode)
+    {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+        return "immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+        return "mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR:
+        return "fifo";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+        return "fifo_relaxed";
+    default:
+        return "other";
+    }
+}
+
+
+Swapchain::Swapchain(
+    const Device&               device,
+    const std::uint32_t         width,
+    const std::uint32_t         height,
+    const SwapchainSettings&    settings) :
+    device(device),
+    settings(settings)
 {
     if (!device.Supports(PresentQueue))
     {
         throw Exception("Cannot create swapchain for the device that does not support present mode");
     }
+    Create(width, height, VK_NULL_HANDLE);
+}
 
+void Swapchain::Create(const std::uint32_t width, const std::uint32_t height, const VkSwapchainKHR old_swapchain)
+{
     const VkSurfaceCapabilitiesKHR& surface_capabilities = device.GetSurfaceCapabilities();
     const std::vector<VkSurfaceFormatKHR>& surface_formats = device.GetSurfaceFormats();
     const std::vector<VkPresentModeKHR>& present_modes = device.GetPresentModes();
@@ -38,12 +104,12 @@ Swapchain::Swapchain(const Device& device, const std::uint32_t width, const std:
     }
     surface_format = *surface_format_iter;
 
-    // Determine the best available present mode.
+    // Use the requested present mode if available.
     auto present_mode_iter =
-        std::find(present_modes.cbegin(), present_modes.cend(), VK_PRESENT_MODE_MAILBOX_KHR);
+        std::find(present_modes.cbegin(), present_modes.cend(), settings.present_mode);
     present_mode = (present_mode_iter == present_modes.cend()) ?
         VK_PRESENT_MODE_FIFO_KHR :
-        VK_PRESENT_MODE_MAILBOX_KHR;
+        settings.present_mode;
 
     // Compute supported swapchain image extents.
     extent = surface_capabilities.currentExtent;
@@ -56,7 +122,9 @@ Swapchain::Swapchain(const Device& device, const std::uint32_t width, const std:
         };
     }
 
-    std::uint32_t image_count = surface_capabilities.minImageCount + 1;
+    std::uint32_t image_count = (settings.image_count == 0u) ?
+        surface_capabilities.minImageCount + 1 :
+        std::max(settings.image_count, surface_capabilities.minImageCount);
     if (surface_capabilities.maxImageCount > 0)
         image_count = std::min(surface_capabilities.maxImageCount, image_count);
 
@@ -70,11 +138,23 @@ Swapchain::Swapchain(const Device& device, const std::uint32_t width, const std:
     create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
     create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    create_info.imageUsage |= surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT; // For frame readback
+
+    bool storage = false;
+    if (settings.storage_images && (surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) != 0u)
+    {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(device.GetPhysicalDevice(), surface_format.format, &format_properties);
+        storage = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0u;
+    }
+    if (storage)
+        create_info.imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
 
     std::vector<std::uint32_t> unique_queue_family_indices; unique_queue_family_indices.reserve(AllQueueTypes().size());
     for (auto queue_type : AllQueueTypes())
     {
-        if (device.Supports(queue_type))
+        // Swapchain images are never touched by the transfer queue.
+        if (queue_type != TransferQueue && device.Supports(queue_type))
             PushBackUnique(unique_queue_family_indices, device.GetQueueFamilyIndex(queue_type));
     }
     assert(unique_queue_family_indices.size() > 0);
@@ -93,25 +173,69 @@ Swapchain::Swapchain(const Device& device, const std::uint32_t width, const std:
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     create_info.presentMode = present_mode;
     create_info.clipped = VK_TRUE;
-    create_info.oldSwapchain = VK_NULL_HANDLE;
+    create_info.oldSwapchain = old_swapchain;
 
-    if (vkCreateSwapchainKHR(device.GetHandle(), &create_info, nullptr, &handle) != VK_SUCCESS)
+    // The old swapchain stays valid if the new one cannot be created.
+    VkSwapchainKHR new_handle = VK_NULL_HANDLE;
+    if (vkCreateSwapchainKHR(device.GetHandle(), &create_info, nullptr, &new_handle) != VK_SUCCESS)
     {
         throw Exception("Failed to create swapchain");
     }
 
-    vkGetSwapchainImagesKHR(device.GetHandle(), handle, &image_count, nullptr);
-    images.resize(image_count);
-    vkGetSwapchainImagesKHR(device.GetHandle(), handle, &image_count, images.data());
+    vkGetSwapchainImagesKHR(device.GetHandle(), new_handle, &image_count, nullptr);
+    std::vector<VkImage> new_images(image_count);
+    vkGetSwapchainImagesKHR(device.GetHandle(), new_handle, &image_count, new_images.data());
+
+    std::vector<VkImageView> new_image_views;
+    for (const VkImage image : new_images)
+    {
+        VkImageViewCreateInfo view_create_info = {};
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.image = image;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = surface_format.format;
+        view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_create_info.subresourceRange.levelCount = 1u;
+        view_create_info.subresourceRange.layerCount = 1u;
+
+        VkImageView image_view = VK_NULL_HANDLE;
+        if (vkCreateImageView(device.GetHandle(), &view_create_info, nullptr, &image_view) != VK_SUCCESS)
+        {
+            DestroyImageViews(new_image_views);
+            vkDestroySwapchainKHR(device.GetHandle(), new_handle, nullptr);
+            throw Exception("Failed to create swapchain image view");
+        }
+        new_image_views.push_back(image_view);
+    }
+
+    handle = new_handle;
+    images = std::move(new_images);
+    image_views = std::move(new_image_views);
+    supports_storage = storage;
+}
+
+void Swapchain::DestroyImageViews(const std::vector<VkImageView>& views) const
+{
+    for (const VkImageView view : views)
+    {
+        vkDestroyImageView(device.GetHandle(), view, nullptr);
+    }
 }
 
 Swapchain::Swapchain(Swapchain&& other) :
     Object<VkSwapchainKHR>(std::move(other)),
     device(other.device),
+    settings(other.settings),
     images(std::move(other.images)),
+    image_views(std::move(other.image_views)),
     surface_format(other.surface_format),
     present_mode(other.present_mode),
-    extent(other.extent)
+    extent(other.extent),
+    supports_storage(other.supports_storage),
+    retired_swapchains(std::move(other.retired_swapchains)),
+    statistics(other.statistics),
+    last_present_time(other.last_present_time),
+    has_presented(other.has_presented)
 {
 }
 
@@ -120,6 +244,16 @@ const std::vector<VkImage>& Swapchain::GetImages() const
     return images;
 }
 
+const std::vector<VkImageView>& Swapchain::GetImageViews() const
+{
+    return image_views;
+}
+
+bool Swapchain::SupportsStorage() const
+{
+    return supports_storage;
+}
+
 VkSurfaceFormatKHR Swapchain::GetSurfaceFormat() const
 {
     return surface_format;
@@ -135,9 +269,25 @@ VkExtent2D Swapchain::GetExtent() const
     return extent;
 }
 
-std::uint32_t Swapchain::AcquireNextImageIndex(const Semaphore& semaphore)
+const SwapchainSettings& Swapchain::GetSettings() const
+{
+    return settings;
+}
+
+const SwapchainStatistics& Swapchain::GetStatistics() const
+{
+    return statistics;
+}
+
+void Swapchain::ResetStatistics()
+{
+    statistics = SwapchainStatistics();
+    has_presented = false;
+}
+
+SwapchainStatus Swapchain::AcquireNextImageIndex(const Semaphore& semaphore, std::uint32_t& image_index)
 {
-    std::uint32_t image_index = ~0u;
+    const auto acquire_start = std::chrono::steady_clock::now();
     const VkResult status = vkAcquireNextImageKHR(
         device.GetHandle(),
         handle,
@@ -145,16 +295,117 @@ std::uint32_t Swapchain::AcquireNextImageIndex(const Semaphore& semaphore)
         semaphore.GetHandle(),
         VK_NULL_HANDLE,
         &image_index);
-    if (status != VK_SUCCESS)
+    const double acquire_wait = std::chrono::duration<double>(std::chrono::steady_clock::now() - acquire_start).count();
+    ++statistics.acquire_count;
+    statistics.total_acquire_wait += acquire_wait;
+    statistics.max_acquire_wait = std::max(statistics.max_acquire_wait, acquire_wait);
+
+    switch (status)
     {
+    case VK_SUCCESS:
+        return SwapchainStatus::Optimal;
+    case VK_SUBOPTIMAL_KHR:
+        return SwapchainStatus::Suboptimal;
+    case VK_ERROR_OUT_OF_DATE_KHR:
+        return SwapchainStatus::OutOfDate;
+    default:
         throw Exception("Failed to acquire next image from the swapchain");
     }
-    assert(image_index != ~0u);
-    return image_index;
+}
+
+SwapchainStatus Swapchain::Present(const Semaphore& wait_semaphore, const std::uint32_t image_index)
+{
+    VkPresentInfoKHR present_info = {};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &wait_semaphore.GetHandle();
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &handle;
+    present_info.pImageIndices = &image_index;
+    const VkResult status = vkQueuePresentKHR(device.GetQueue(PresentQueue), &present_info);
+
+    const auto present_time = std::chrono::steady_clock::now();
+    if (has_presented)
+    {
+        // Welford's running mean and variance.
+        const double interval = std::chrono::duration<double>(present_time - last_present_time).count();
+        ++statistics.present_interval_count;
+        const double delta = interval - statistics.mean_present_interval;
+        statistics.mean_present_interval += delta / static_cast<double>(statistics.present_interval_count);
+        statistics.present_interval_m2 += delta * (interval - statistics.mean_present_interval);
+
+        statistics.refresh_interval = settings.refresh_interval;
+        if (settings.refresh_interval > 0.0)
+        {
+            const double refreshes = interval / settings.refresh_interval;
+            if (refreshes > 1.5)
+            {
+                ++statistics.late_present_count;
+                statistics.missed_refresh_count += static_cast<std::uint64_t>(std::floor(refreshes + 0.5)) - 1u;
+            }
+        }
+    }
+    last_present_time = present_time;
+    has_presented = true;
+
+    switch (status)
+    {
+    case VK_SUCCESS:
+        return SwapchainStatus::Optimal;
+    case VK_SUBOPTIMAL_KHR:
+        return SwapchainStatus::Suboptimal;
+    case VK_ERROR_OUT_OF_DATE_KHR:
+        return SwapchainStatus::OutOfDate;
+    default:
+        throw Exception("Failed to present the frame");
+    }
+}
+
+void Swapchain::Recreate(const std::uint32_t width, const std::uint32_t height)
+{
+    RetiredSwapchain retired;
+    retired.handle = handle;
+    retired.image_views = image_views;
+    Create(width, height, retired.handle);
+    retired_swapchains.push_back(std::move(retired));
+    // The gap around the recreation says nothing about presentation.
+    has_presented = false;
+}
+
+void Swapchain::Recreate(const std::uint32_t width, const std::uint32_t height, const SwapchainSettings& new_settings)
+{
+    const SwapchainSettings previous_settings = settings;
+    settings = new_settings;
+    try
+    {
+        Recreate(width, height);
+    }
+    catch (...)
+    {
+        settings = previous_settings;
+        throw;
+    }
+}
+
+bool Swapchain::HasRetired() const
+{
+    return !retired_swapchains.empty();
+}
+
+void Swapchain::DestroyRetired()
+{
+    for (const RetiredSwapchain& retired : retired_swapchains)
+    {
+        DestroyImageViews(retired.image_views);
+        vkDestroySwapchainKHR(device.GetHandle(), retired.handle, nullptr);
+    }
+    retired_swapchains.clear();
 }
 
 Swapchain::~Swapchain()
 {
+    DestroyRetired();
+    DestroyImageViews(image_views);
     vkDestroySwapchainKHR(device.GetHandle(), handle, nullptr);
 }
 
@@ -2,6 +2,8 @@
 
 
 #include <algorithm>
+#include <chrono>
+#include <ostream>
 #include <vector>
 
 #include <vulkan/object.h>
@@ -32,26 +34,121 @@ namespace ct
         class Semaphore;
 
 
+        struct SwapchainSettings
+        {
+            // Falls back to FIFO, the only mode every device supports, when the surface lacks it.
+            VkPresentModeKHR    present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+            // Zero picks one more than the surface minimum. Fewer images shorten the queue in front of
+            // the display at the cost of blocking in acquire sooner. Clamped to what the surface supports.
+            std::uint32_t       image_count = 0u;
+            // Refresh interval of the display in seconds, to tell late presents and missed refreshes.
+            // Zero means unknown: present intervals are still recorded, but not classified.
+            double              refresh_interval = 0.0;
+            // Lets compute passes write the images directly. Only granted when the surface and its format
+            // support storage images, see Swapchain::SupportsStorage(). Off by default, since storage usage
+            // can keep the driver from compressing the images.
+            bool                storage_images = false;
+        };
+
+
+        // Presentation as seen from the host. Intervals are taken between successive Present() calls,
+        // which the presentation engine throttles in FIFO modes. A present is late if it comes more than
+        // half a refresh interval after the refresh it was due for; every refresh it skipped is missed.
+        // Late presents and missed refreshes are only counted when the refresh interval is known.
+        struct SwapchainStatistics
+        {
+            std::uint64_t   acquire_count = 0u;
+            double          total_acquire_wait = 0.0;
+            double          max_acquire_wait = 0.0;
+
+            std::uint64_t   present_interval_count = 0u;
+            double          mean_present_interval = 0.0;
+            double          present_interval_m2 = 0.0;
+            std::uint64_t   late_present_count = 0u;
+            std::uint64_t   missed_refresh_count = 0u;
+            double          refresh_interval = 0.0; // Zero if unknown
+
+            double GetAverageAcquireWait() const;
+            // Standard deviation of the present-to-present interval.
+            double GetPresentJitter() const;
+
+            void WriteJson(std::ostream& stream) const;
+        };
+
+
+        // The name CT_PRESENT_MODE uses for the mode, or "other".
+        const char* GetPresentModeName(const VkPresentModeKHR present_mode);
+
+
+        enum class SwapchainStatus
+        {
+            Optimal,
+            // Still usable, but no longer matches the surface and should be recreated.
+            Suboptimal,
+            // Unusable; nothing was acquired or presented, and it has to be recreated.
+            OutOfDate
+        };
+
+
         class Swapchain : public Object<VkSwapchainKHR>
         {
         public:
-            explicit Swapchain(const Device& device, const std::uint32_t width, const std::uint32_t height);
+            explicit Swapchain(
+                const Device&               device,
+                const std::uint32_t         width,
+                const std::uint32_t         height,
+                const SwapchainSettings&    settings = SwapchainSettings());
             Swapchain(Swapchain&& swapchain);
 
             const std::vector<VkImage>& GetImages() const;
+            const std::vector<VkImageView>& GetImageViews() const;
+            bool SupportsStorage() const;
             VkSurfaceFormatKHR GetSurfaceFormat() const;
             VkPresentModeKHR GetPresentMode() const;
             VkExtent2D GetExtent() const;
-            std::uint32_t AcquireNextImageIndex(const Semaphore& semaphore);
+            const SwapchainSettings& GetSettings() const;
+            const SwapchainStatistics& GetStatistics() const;
+            void ResetStatistics();
+
+            // On OutOfDate the semaphore is not signaled and image_index is not set.
+            SwapchainStatus AcquireNextImageIndex(const Semaphore& semaphore, std::uint32_t& image_index);
+            SwapchainStatus Present(const Semaphore& wait_semaphore, const std::uint32_t image_index);
+
+            // Replaces the swapchain with one for the current surface, passing the old one as oldSwapchain
+            // so the presentation engine can hand its resources over. The old swapchain is retired rather
+            // than destroyed because frames in flight may still use its images; DestroyRetired() has to be
+            // called once they have finished.
+            void Recreate(const std::uint32_t width, const std::uint32_t height);
+            void Recreate(const std::uint32_t width, const std::uint32_t height, const SwapchainSettings& new_settings);
+            bool HasRetired() const;
+            void DestroyRetired();
 
             ~Swapchain();
 
         private:
-            const Device&           device;
-            std::vector<VkImage>    images;
-            VkSurfaceFormatKHR      surface_format;
-            VkPresentModeKHR        present_mode;
-            VkExtent2D              extent;
+            // The views of a retired swapchain's images may still be in use as well.
+            struct RetiredSwapchain
+            {
+                VkSwapchainKHR              handle;
+                std::vector<VkImageView>    image_views;
+            };
+
+            void Create(const std::uint32_t width, const std::uint32_t height, const VkSwapchainKHR old_swapchain);
+            void DestroyImageViews(const std::vector<VkImageView>& views) const;
+
+            const Device&                   device;
+            SwapchainSettings               settings;
+            std::vector<VkImage>            images;
+            std::vector<VkImageView>        image_views;
+            VkSurfaceFormatKHR              surface_format;
+            VkPresentModeKHR                present_mode;
+            VkExtent2D                      extent;
+            bool                            supports_storage = false;
+            std::vector<RetiredSwapchain>   retired_swapchains;
+
+            SwapchainStatistics                                 statistics;
+            std::chrono::steady_clock::time_point               last_present_time;
+            bool                                                has_presented = false;
         };
     }
 }
@@ -79,8 +79,8 @@ bool Fence::WaitOnce(const float timeout) const
 {
     if (!IsSignaled())
     {
-        const auto timeout_microseconds = static_cast<uint64_t>(1.0e+9 * timeout);
-        const auto status = vkWaitForFences(device.GetHandle(), 1u, &handle, true, timeout_microseconds);
+        const auto timeout_nanoseconds = static_cast<uint64_t>(1.0e+9 * timeout);
+        const auto status = vkWaitForFences(device.GetHandle(), 1u, &handle, true, timeout_nanoseconds);
         switch (status)
         {
         case VK_TIMEOUT:
@@ -96,7 +96,10 @@ bool Fence::WaitOnce(const float timeout) const
 
 void Fence::Wait() const
 {
-    do {} while (!WaitOnce(1.0f));
+    if (vkWaitForFences(device.GetHandle(), 1u, &handle, true, InfiniteTimeout) != VK_SUCCESS)
+    {
+        throw Exception("Failed to wait for a fence");
+    }
 }
 
 void Fence::Reset()
@@ -104,5 +107,231 @@ void Fence::Reset()
     vkResetFences(device.GetHandle(), 1u, &handle);
 }
 
+
+
+bool WaitAll(
+    const Device&                   device,
+    const std::vector<const Fence*>& fences,
+    const std::uint64_t             timeout_nanoseconds)
+{
+    if (fences.empty())
+        return true;
+
+    std::vector<VkFence> handles;
+    handles.reserve(fences.size());
+    for (const Fence* fence : fences)
+    {
+        handles.push_back(fence->GetHandle());
+    }
+
+    const auto status = vkWaitForFences(
+        device.GetHandle(),
+        static_cast<std::uint32_t>(handles.size()),
+        handles.data(),
+        true,
+        timeout_nanoseconds);
+    switch (status)
+    {
+    case VK_TIMEOUT:
+        return false;
+    case VK_SUCCESS:
+        return true;
+    default:
+        throw Exception("Failed to wait for fences");
+    }
+}
+
+std::size_t WaitAny(
+    const Device&                   device,
+    const std::vector<const Fence*>& fences,
+    const std::uint64_t             timeout_nanoseconds)
+{
+    if (fences.empty())
+        return 0u;
+
+    std::vector<VkFence> handles;
+    handles.reserve(fences.size());
+    for (const Fence* fence : fences)
+    {
+        handles.push_back(fence->GetHandle());
+    }
+
+    const auto status = vkWaitForFences(
+        device.GetHandle(),
+        static_cast<std::uint32_t>(handles.size()),
+        handles.data(),
+        false,
+        timeout_nanoseconds);
+    switch (status)
+    {
+    case VK_TIMEOUT:
+        return fences.size();
+    case VK_SUCCESS:
+        break;
+    default:
+        throw Exception("Failed to wait for fences");
+    }
+
+    // Vulkan does not say which fence woke the wait.
+    const auto signaled = std::find_if(fences.cbegin(), fences.cend(), [](const Fence* fence)
+    {
+        return fence->IsSignaled();
+    });
+    return static_cast<std::size_t>(signaled - fences.cbegin());
+}
+
+
+
+FencePool::FencePool(const Device& device) : device(device)
+{
+}
+
+Fence& FencePool::Acquire()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (free_fences.empty() && !recycled_fences.empty())
+    {
+        std::vector<VkFence> handles;
+        handles.reserve(recycled_fences.size());
+        for (const Fence* fence : recycled_fences)
+        {
+            handles.push_back(fence->GetHandle());
+        }
+        if (vkResetFences(device.GetHandle(), static_cast<std::uint32_t>(handles.size()), handles.data()) != VK_SUCCESS)
+        {
+            throw Exception("Failed to reset fences");
+        }
+        free_fences.swap(recycled_fences);
+    }
+
+    if (free_fences.empty())
+    {
+        fences.push_back(std::make_unique<Fence>(device));
+        return *fences.back();
+    }
+
+    Fence& fence = *free_fences.back();
+    free_fences.pop_back();
+    return fence;
+}
+
+void FencePool::Recycle(Fence& fence)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(std::find_if(fences.cbegin(), fences.cend(), [&fence](const std::unique_ptr<Fence>& owned_fence)
+    {
+        return owned_fence.get() == &fence;
+    }) != fences.cend());
+    recycled_fences.push_back(&fence);
+}
+
+std::size_t FencePool::GetCreatedCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return fences.size();
+}
+
+
+
+TimelineSemaphore::TimelineSemaphore(const Device& device, const std::uint64_t initial_value) : device(device)
+{
+    if (!device.SupportsTimelineSemaphores())
+    {
+        throw Exception("Failed to create timeline semaphore: the device does not support them");
+    }
+
+    VkSemaphoreTypeCreateInfoKHR type_info = {};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    type_info.initialValue = initial_value;
+
+    VkSemaphoreCreateInfo semaphore_info = {};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+    if (vkCreateSemaphore(device.GetHandle(), &semaphore_info, nullptr, &handle) != VK_SUCCESS)
+    {
+        throw Exception("Failed to create timeline semaphore");
+    }
+}
+
+TimelineSemaphore::TimelineSemaphore(TimelineSemaphore&& other) :
+    Object<VkSemaphore>(std::move(other)),
+    device(other.device)
+{
+}
+
+TimelineSemaphore::~TimelineSemaphore()
+{
+    if (handle != VK_NULL_HANDLE)
+    {
+        vkDestroySemaphore(device.GetHandle(), handle, nullptr);
+    }
+}
+
+std::uint64_t TimelineSemaphore::GetValue() const
+{
+    std::uint64_t value = 0u;
+    const auto status = device.GetTimelineSemaphoreFunctions().get_counter_value(device.GetHandle(), handle, &value);
+    if (status == VK_ERROR_DEVICE_LOST)
+    {
+        throw Exception("Device has been lost");
+    }
+    return value;
+}
+
+bool TimelineSemaphore::IsReached(const std::uint64_t value) const
+{
+    return GetValue() >= value;
+}
+
+bool TimelineSemaphore::WaitOnce(const std::uint64_t value, const float timeout) const
+{
+    if (!IsReached(value))
+    {
+        VkSemaphoreWaitInfoKHR wait_info = {};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+        wait_info.semaphoreCount = 1u;
+        wait_info.pSemaphores = &handle;
+        wait_info.pValues = &value;
+        const auto timeout_nanoseconds = static_cast<uint64_t>(1.0e+9 * timeout);
+        const auto status = device.GetTimelineSemaphoreFunctions().wait(device.GetHandle(), &wait_info, timeout_nanoseconds);
+        switch (status)
+        {
+        case VK_TIMEOUT:
+            return false;
+        case VK_SUCCESS:
+            return true;
+        default:
+            throw Exception("Failed to wait for a timeline semaphore");
+        }
+    }
+    return true;
+}
+
+void TimelineSemaphore::Wait(const std::uint64_t value) const
+{
+    VkSemaphoreWaitInfoKHR wait_info = {};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    wait_info.semaphoreCount = 1u;
+    wait_info.pSemaphores = &handle;
+    wait_info.pValues = &value;
+    if (device.GetTimelineSemaphoreFunctions().wait(device.GetHandle(), &wait_info, InfiniteTimeout) != VK_SUCCESS)
+    {
+        throw Exception("Failed to wait for a timeline semaphore");
+    }
+}
+
+void TimelineSemaphore::Signal(const std::uint64_t value)
+{
+    VkSemaphoreSignalInfoKHR signal_info = {};
+    signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO_KHR;
+    signal_info.semaphore = handle;
+    signal_info.value = value;
+    if (device.GetTimelineSemaphoreFunctions().signal(device.GetHandle(), &signal_info) != VK_SUCCESS)
+    {
+        throw Exception("Failed to signal a timeline semaphore");
+    }
+}
+
 } // namespace vulkan
 } // namespace ct
@@ -3,6 +3,10 @@
 
 #include <vulkan/object.h>
 #include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 
 namespace ct
@@ -37,5 +41,64 @@ namespace ct
         private:
             const Device& device;
         };
+
+
+        constexpr std::uint64_t InfiniteTimeout = ~std::uint64_t(0u);
+
+        // Block on many fences with a single vkWaitForFences. WaitAll returns whether every fence was
+        // signaled before the timeout. WaitAny returns the index of a signaled fence, or fences.size()
+        // if none was signaled before the timeout.
+        bool WaitAll(
+            const Device&                   device,
+            const std::vector<const Fence*>& fences,
+            const std::uint64_t             timeout_nanoseconds = InfiniteTimeout);
+        std::size_t WaitAny(
+            const Device&                   device,
+            const std::vector<const Fence*>& fences,
+            const std::uint64_t             timeout_nanoseconds = InfiniteTimeout);
+
+
+        // Recycles fences so steady-state frames create none. Acquire() hands out an unsignaled fence and
+        // Recycle() takes it back once nobody waits on it any more. Recycled fences are reset together
+        // with one vkResetFences when no reset fence is left. Safe to use from several threads.
+        class FencePool
+        {
+        public:
+            explicit FencePool(const Device& device);
+            FencePool(const FencePool& other) = delete;
+
+            Fence& Acquire();
+            void Recycle(Fence& fence);
+
+            std::size_t GetCreatedCount() const;
+
+        private:
+            const Device&                       device;
+            mutable std::mutex                  mutex;
+            std::vector<std::unique_ptr<Fence>> fences;
+            std::vector<Fence*>                 free_fences;
+            std::vector<Fence*>                 recycled_fences;
+        };
+
+
+        // Semaphore with a 64-bit value that only grows. Queues wait for and signal values through
+        // SubmitBatch, and the host can query, wait for and signal them directly, so a single semaphore
+        // can track every frame ("frame N-2 has finished") where binary semaphores and fences need one each.
+        // Requires Device::SupportsTimelineSemaphores().
+        class TimelineSemaphore : public Object<VkSemaphore>
+        {
+        public:
+            explicit TimelineSemaphore(const Device& device, const std::uint64_t initial_value = 0u);
+            TimelineSemaphore(TimelineSemaphore&& other);
+            ~TimelineSemaphore();
+
+            std::uint64_t GetValue() const;
+            bool IsReached(const std::uint64_t value) const;
+            bool WaitOnce(const std::uint64_t value, const float timeout) const;
+            void Wait(const std::uint64_t value) const;
+            void Signal(const std::uint64_t value);
+        private:
+            const Device& device;
+        };
     }
 }
@@ -0,0 +1,172 @@
+#include "thread_command_pools.h"
+
+
+#include <algorithm>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+ThreadCommandPools::ThreadCommandPools(
+    const Device&       device,
+    const QueueType     queue_type,
+    const std::uint32_t frames_in_flight,
+    const std::size_t   worker_count) :
+    owner_thread_id(std::this_thread::get_id()),
+    owner_pools(device, queue_type, frames_in_flight)
+{
+    // hardware_concurrency() may return 0 when it cannot tell.
+    const std::size_t thread_count = std::max<std::size_t>(worker_count, 1u);
+    worker_pools.reserve(thread_count);
+    for (std::size_t i = 0u; i != thread_count; ++i)
+    {
+        worker_pools.push_back(std::make_unique<FrameCommandPools>(device, queue_type, frames_in_flight));
+    }
+    workers.reserve(thread_count);
+    for (std::size_t i = 0u; i != thread_count; ++i)
+    {
+        workers.emplace_back(&ThreadCommandPools::WorkerLoop, this, i);
+    }
+}
+
+ThreadCommandPools::~ThreadCommandPools()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_started.notify_all();
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadCommandPools::BeginFrame()
+{
+    assert(std::this_thread::get_id() == owner_thread_id);
+    owner_pools.BeginFrame();
+    for (auto& pools : worker_pools)
+    {
+        pools->BeginFrame();
+    }
+}
+
+void ThreadCommandPools::EndFrame(const Fence& fence)
+{
+    assert(std::this_thread::get_id() == owner_thread_id);
+    owner_pools.EndFrame(fence);
+    for (auto& pools : worker_pools)
+    {
+        pools->EndFrame(fence);
+    }
+}
+
+CommandBuffer& ThreadCommandPools::AcquireCommandBuffer(const CommandBufferLevel level)
+{
+    assert(std::this_thread::get_id() == owner_thread_id);
+    return owner_pools.AcquireCommandBuffer(level);
+}
+
+std::vector<CommandBuffer*> ThreadCommandPools::RecordSecondaryCommandBuffers(
+    const std::size_t               slice_count,
+    const RecordFunction&           record,
+    const CommandBufferInheritance& inheritance)
+{
+    assert(std::this_thread::get_id() == owner_thread_id);
+    std::vector<CommandBuffer*> results(slice_count, nullptr);
+    if (slice_count == 0u)
+        return results;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.record = &record;
+        job.inheritance = &inheritance;
+        job.results = &results;
+        job.next_slice = 0u;
+        job.exception = nullptr;
+        busy_worker_count = workers.size();
+        ++job_generation;
+    }
+    job_started.notify_all();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    job_finished.wait(lock, [this]()
+    {
+        return busy_worker_count == 0u;
+    });
+    if (job.exception != nullptr)
+    {
+        std::rethrow_exception(job.exception);
+    }
+    return results;
+}
+
+std::size_t ThreadCommandPools::GetWorkerCount() const
+{
+    return workers.size();
+}
+
+void ThreadCommandPools::WorkerLoop(const std::size_t worker_index)
+{
+    std::uint64_t seen_generation = 0u;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_started.wait(lock, [this, seen_generation]()
+            {
+                return stopping || job_generation != seen_generation;
+            });
+            if (stopping)
+                return;
+            seen_generation = job_generation;
+        }
+
+        RunJob(worker_index);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy_worker_count;
+        }
+        job_finished.notify_one();
+    }
+}
+
+void ThreadCommandPools::RunJob(const std::size_t worker_index)
+{
+    // Slices are pulled one at a time so uneven slices still spread over all workers.
+    FrameCommandPools& pools = *worker_pools[worker_index];
+    for (;;)
+    {
+        const std::size_t slice_index = job.next_slice++;
+        if (slice_index >= job.results->size())
+            return;
+
+        try
+        {
+            CommandBuffer& command_buffer = pools.AcquireCommandBuffer(SecondaryCommandBuffer);
+            {
+                CommandRecorder recorder(command_buffer, *job.inheritance);
+                (*job.record)(recorder, slice_index);
+            }
+            (*job.results)[slice_index] = &command_buffer;
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (job.exception == nullptr)
+            {
+                job.exception = std::current_exception();
+            }
+            // Let the other workers run out of slices.
+            job.next_slice = job.results->size();
+            return;
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <vulkan/command_pool.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        // Command pools must not be used by two threads at once, so the owning thread and each of the
+        // persistent worker threads get their own set of per-frame pools. Workers record slices of a
+        // frame into secondary command buffers that the owning thread then executes from a primary one.
+        class ThreadCommandPools
+        {
+        public:
+            explicit ThreadCommandPools(
+                const Device&       device,
+                const QueueType     queue_type,
+                const std::uint32_t frames_in_flight,
+                const std::size_t   worker_count = std::thread::hardware_concurrency());
+            ThreadCommandPools(const ThreadCommandPools& other) = delete;
+            ~ThreadCommandPools();
+
+            void BeginFrame();
+            void EndFrame(const Fence& fence);
+
+            // A command buffer from the owning thread's pools, valid until the current frame's pools are reused.
+            CommandBuffer& AcquireCommandBuffer(const CommandBufferLevel level = PrimaryCommandBuffer);
+
+            using RecordFunction = std::function<void(CommandRecorder& recorder, const std::size_t slice_index)>;
+
+            // Records slice_count secondary command buffers on the worker threads and returns them in
+            // slice order, ready for CommandRecorder::ExecuteCommands. Blocks until all slices are recorded
+            // and rethrows the first exception thrown by a worker.
+            std::vector<CommandBuffer*> RecordSecondaryCommandBuffers(
+                const std::size_t               slice_count,
+                const RecordFunction&           record,
+                const CommandBufferInheritance& inheritance = CommandBufferInheritance());
+
+            std::size_t GetWorkerCount() const;
+
+        private:
+            struct Job
+            {
+                const RecordFunction*           record = nullptr;
+                const CommandBufferInheritance* inheritance = nullptr;
+                std::vector<CommandBuffer*>*    results = nullptr;
+                std::atomic<std::size_t>        next_slice{ 0u };
+                std::exception_ptr              exception;
+            };
+
+            void WorkerLoop(const std::size_t worker_index);
+            void RunJob(const std::size_t worker_index);
+
+            const std::thread::id                               owner_thread_id;
+            FrameCommandPools                                   owner_pools;
+            std::vector<std::unique_ptr<FrameCommandPools>>     worker_pools;
+            std::vector<std::thread>                            workers;
+
+            Job                                                 job;
+            std::uint64_t                                       job_generation = 0u;
+            std::size_t                                         busy_worker_count = 0u;
+            bool                                                stopping = false;
+            std::mutex                                          mutex;
+            std::condition_variable                             job_started;
+            std::condition_variable                             job_finished;
+        };
+    }
+}
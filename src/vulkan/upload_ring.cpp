@@ -0,0 +1,126 @@
+#include "upload_ring.h"
+
+#include <algorithm>
+
+#include <utils/align.h>
+#include <vulkan/exception.h>
+#include <vulkan/synchronization.h>
+
+
+namespace ct
+{
+namespace vulkan
+{
+
+namespace
+{
+
+// Every frame region starts at an offset that is valid for descriptors and for flushes.
+VkDeviceSize AlignFrameSize(const Device& device, const VkDeviceSize frame_size_in_bytes)
+{
+    const VkPhysicalDeviceLimits& limits = device.GetProperties().limits;
+    const VkDeviceSize alignment = std::max({
+        limits.minUniformBufferOffsetAlignment,
+        limits.minStorageBufferOffsetAlignment,
+        limits.nonCoherentAtomSize });
+    return utils::AlignUp(frame_size_in_bytes, alignment);
+}
+
+}
+
+UploadRing::UploadRing(
+    const Device&       device,
+    const VkDeviceSize  frame_size_in_bytes,
+    const std::uint32_t frames_in_flight) :
+    buffer(device, static_cast<std::size_t>(AlignFrameSize(device, frame_size_in_bytes) * frames_in_flight)),
+    frame_size(AlignFrameSize(device, frame_size_in_bytes)),
+    default_alignment(std::max(
+        device.GetProperties().limits.minUniformBufferOffsetAlignment,
+        device.GetProperties().limits.minStorageBufferOffsetAlignment)),
+    frame_fences(frames_in_flight, nullptr),
+    frame_index(0u),
+    head(0u)
+{
+    assert(frames_in_flight > 0u);
+}
+
+void UploadRing::BeginFrame()
+{
+    frame_index = (frame_index + 1u) % static_cast<std::uint32_t>(frame_fences.size());
+    head = 0u;
+
+    const Fence* fence = frame_fences[frame_index];
+    if (fence != nullptr)
+    {
+        fence->Wait();
+        frame_fences[frame_index] = nullptr;
+    }
+}
+
+void UploadRing::EndFrame(const Fence& fence)
+{
+    frame_fences[frame_index] = &fence;
+}
+
+void UploadRing::Flush() const
+{
+    const MemoryAllocation& allocation = buffer.GetAllocation();
+    if (allocation.IsHostCoherent() || head == 0u)
+        return;
+
+    const VkDeviceSize atom_size = buffer.GetDevice().GetProperties().limits.nonCoherentAtomSize;
+    const VkDeviceSize first_byte = allocation.offset + frame_index * frame_size;
+
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.vk_memory;
+    range.offset = utils::AlignDown(first_byte, atom_size);
+    range.size = std::min(
+        utils::AlignUp(first_byte + head, atom_size),
+        allocation.offset + allocation.size) - range.offset;
+    if (vkFlushMappedMemoryRanges(buffer.GetDevice().GetHandle(), 1u, &range) != VK_SUCCESS)
+    {
+        throw Exception("Failed to flush the upload ring");
+    }
+}
+
+UploadAllocation UploadRing::Allocate(const VkDeviceSize size)
+{
+    return Allocate(size, default_alignment);
+}
+
+UploadAllocation UploadRing::Allocate(const VkDeviceSize size, const VkDeviceSize alignment)
+{
+    // Align the offset within the buffer, which is what descriptors see, not the one within the frame.
+    const VkDeviceSize frame_start = frame_index * frame_size;
+    const VkDeviceSize offset = utils::AlignUp(frame_start + head, alignment) - frame_start;
+    if (offset + size > frame_size)
+    {
+        throw Exception("Upload ring frame region is exhausted");
+    }
+    head = offset + size;
+
+    UploadAllocation allocation;
+    allocation.vk_buffer = buffer.GetBufferHandle();
+    allocation.offset = frame_start + offset;
+    allocation.data = buffer.GetMappedData() + allocation.offset;
+    return allocation;
+}
+
+VkBuffer UploadRing::GetBufferHandle() const
+{
+    return buffer.GetBufferHandle();
+}
+
+VkDeviceSize UploadRing::GetFrameSizeInBytes() const
+{
+    return frame_size;
+}
+
+VkDeviceSize UploadRing::GetUsedSizeInBytes() const
+{
+    return head;
+}
+
+}
+}
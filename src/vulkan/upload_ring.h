@@ -0,0 +1,82 @@
+#pragma once
+
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include <vulkan/device.h>
+#include <vulkan/memory.h>
+
+
+namespace ct
+{
+    namespace vulkan
+    {
+        class Fence;
+
+
+        struct UploadAllocation
+        {
+            VkBuffer        vk_buffer = VK_NULL_HANDLE;
+            VkDeviceSize    offset = 0u;
+            void*           data = nullptr;
+        };
+
+
+        // Linear allocator for per-frame uniform and staging data. A single persistently
+        // mapped buffer is split into one region per frame in flight; a region is reused
+        // only after the fence of the frame that last used it has been signaled. The frame size
+        // is rounded up so that every region starts at a valid descriptor offset.
+        class UploadRing
+        {
+        public:
+            using RingBuffer = Buffer<
+                std::uint8_t,
+                HostMemory,
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT>;
+
+            explicit UploadRing(
+                const Device&       device,
+                const VkDeviceSize  frame_size_in_bytes,
+                const std::uint32_t frames_in_flight);
+            UploadRing(const UploadRing& other) = delete;
+
+            void BeginFrame();
+            void EndFrame(const Fence& fence);
+
+            // Makes the data written to the current frame region visible to the device.
+            // Only does work if the ring landed in non-coherent memory.
+            void Flush() const;
+
+            UploadAllocation Allocate(const VkDeviceSize size);
+            UploadAllocation Allocate(const VkDeviceSize size, const VkDeviceSize alignment);
+
+            template <typename T>
+            UploadAllocation Upload(const T& value);
+
+            VkBuffer GetBufferHandle() const;
+            VkDeviceSize GetFrameSizeInBytes() const;
+            VkDeviceSize GetUsedSizeInBytes() const;
+
+        private:
+            RingBuffer                  buffer;
+            const VkDeviceSize          frame_size;
+            const VkDeviceSize          default_alignment;
+            std::vector<const Fence*>   frame_fences;
+            std::uint32_t               frame_index;
+            VkDeviceSize                head;
+        };
+    }
+}
+
+
+
+template <typename T>
+inline ct::vulkan::UploadAllocation ct::vulkan::UploadRing::Upload(const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be uploaded");
+    UploadAllocation allocation = Allocate(sizeof(T));
+    std::memcpy(allocation.data, &value, sizeof(T));
+    return allocation;
+}
@@ -7,7 +7,7 @@ namespace ct
 Window::Window(const std::string& name, int default_width, int default_height)
 {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     window = glfwCreateWindow(default_width, default_height, name.c_str(), nullptr, nullptr);
     if (window == nullptr)
@@ -23,6 +23,15 @@ bool Window::ShouldClose() const
 }
 
 
+VkExtent2D Window::GetFramebufferExtent() const
+{
+    int width = 0;
+    int height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    return { static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height) };
+}
+
+
 Window::~Window()
 {
     glfwDestroyWindow(window);
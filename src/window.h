@@ -45,6 +45,9 @@ public:
 
     bool ShouldClose() const;
 
+    // In pixels, which can differ from the window size on high-DPI monitors. Zero while minimized.
+    VkExtent2D GetFramebufferExtent() const;
+
     ~Window();
 
 private: